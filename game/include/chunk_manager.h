@@ -34,13 +34,34 @@ public:
 
     void Abort();
 
+    // throws every chunk away and loads the world again around the camera
+    void Reload();
+
     void DrawDebug3D();
     void DrawDebug2D();
 
+    // calls func for the useable chunks that can be seen, call it inside BeginMode3D
+    // chunks outside the view frustum or past the draw distance are skipped and counted as culled
+    // the draw distance is the radius of the render area, or the fog distance if the fog is thicker than that
     void DoForEachRenderChunk(std::function<void(Voxels::Chunk*)> func);
 
+    // the fogDensity given to the lighting shader, chunks that would be drawn entirely in fog are culled, 0 for no fog
+    void SetFogDensity(float density);
+
+    // chunks skipped by the last DoForEachRenderChunk
+    int GetCulledChunkCount() const { return CulledChunks; }
+
+    // single block edits patch the drawn meshes in place instead of waiting for a remesh
+    void SetBlock(const Voxels::BlockPosition& position, Voxels::BlockType block);
+
     void ToggleShowPreloadChunks() { ShowPreloadChunks = !ShowPreloadChunks; }
 
+    // switches between per face and greedy meshes, so the two can be compared on the same view
+    void SetMeshingMode(Voxels::MeshingMode mode);
+
+    // packed meshes need the packedVertices uniform set on the lighting shader when they are drawn
+    void SetVertexFormat(CubeGeometryBuilder::VertexFormat format);
+
     Voxels::WorldBuilder Builder;
     Voxels::ChunkMeshTaskPool Mesher;
 
@@ -55,15 +76,45 @@ private:
     std::set<uint64_t> ChunksWithMeshes;
     std::set<uint64_t> PendingMeshUnloads;
 
-    static constexpr int RenderDistance = 5;
+    // chunks with a remesh in the mesher, their old mesh is drawn until the new one is ready
+    std::set<uint64_t> RemeshingChunks;
+
+    // chunks that need meshes, sorted closest first
+    std::vector<Voxels::ChunkId> RenderChunks;
+
+    static constexpr int RenderDistance = 7;
     static constexpr int LoadDistance = 4;
 
+    // chunks out to each ring distance are meshed at that level of detail, rings past the last use the lowest
+    static constexpr int LodRings[Voxels::ChunkMesher::MaxLod] = { 2, 4 };
+
+    // chunks only drop to lower detail once they are this many rings past the boundary
+    static constexpr int LodHysteresisRings = 1;
+
+    // chunk layers above and below the camera that are meshed
+    static constexpr int VerticalDistance = 1;
+
     bool ShowPreloadChunks = true;
 
+    // past this everything is drawn in the fog color, 0 for no fog
+    float FogDistance = 0;
+    int CulledChunks = 0;
+
     Vector3                     WorldSpacePosition = { 0 };
 
+    Voxels::ChunkId GetCenterLayerChunk(Voxels::ChunkId column) const;
+    void AddColumn(Voxels::ChunkId column, int verticalDistance, std::vector<Voxels::ChunkId>& chunks) const;
+    void SortByDistance(std::vector<Voxels::ChunkId>& chunks) const;
+
+    int GetRing(Voxels::ChunkId id) const;
+    int GetLodForRing(int ring) const;
+    int GetWantedLod(Voxels::ChunkId id, int currentLod) const;
+
     void ValidateChunkGeneration(Voxels::ChunkId id);
     void ValidateChunkMesh(Voxels::ChunkId id);
+    void RemeshDirtyChunks();
+    void RemeshAll();
+    void UnloadMeshes();
 
     void DrawDebugChunk(Voxels::ChunkId id, Color tint);
 };
\ No newline at end of file
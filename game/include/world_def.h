@@ -14,7 +14,31 @@ static constexpr Voxels::BlockType Copper = 6;
 static constexpr Voxels::BlockType Tree = 8;
 static constexpr Voxels::BlockType Leaves = 9;
 
+// the world is this many chunks tall, terrain height varies over the range above the base ground level
+static constexpr int WorldChunkLayers = 3;
+static constexpr int TerrainHeightRange = 56;
+
+// chunk data past this is evicted, farthest from the camera first
+static constexpr size_t WorldMemoryBudget = size_t(256) * 1024 * 1024;
+
+// blockmap.png is a grid of 8x2 tiles
+static constexpr int BlockAtlasColumns = 8;
+static constexpr int BlockAtlasRows = 2;
+
+static constexpr Voxels::BlockDefinition BlockDefinitions[] =
+{
+    Voxels::BlockDefinition::Open(Air),
+    Voxels::BlockDefinition::Sided(Grass, 2, 0, 0, 0, 1, 0),
+    Voxels::BlockDefinition::Cube(Dirt, 1, 0),
+    Voxels::BlockDefinition::Cube(Stone, 3, 0),
+    Voxels::BlockDefinition::Cube(Bedrock, 4, 0),
+    Voxels::BlockDefinition::Cube(Gold, 5, 0),
+    Voxels::BlockDefinition::Cube(Copper, 6, 0),
+    Voxels::BlockDefinition::Column(Tree, 0, 1, 1, 1),
+    Voxels::BlockDefinition::Cube(Leaves, 2, 1),
+};
+
 void SetupWorldData(Texture2D& texture);
 
 void ChunkGenerationFunction(Voxels::Chunk& chunk);
-void ChunkPopulationFunction(Voxels::Chunk& chunk);
+void ChunkPopulationFunction(Voxels::World& world, Voxels::Chunk& chunk);
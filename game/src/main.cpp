@@ -61,9 +61,14 @@ void SetupBlocks()
     SetTextureFilter(BlockTexture, TEXTURE_FILTER_ANISOTROPIC_16X);
 
     SetupWorldData(BlockTexture);
+    Map.SetChunkLayers(0, WorldChunkLayers - 1);
+    Map.SetMemoryBudget(WorldMemoryBudget);
 
     Manager.Builder.SetTerrainGenerationFunction(ChunkGenerationFunction);
     Manager.Builder.SetPopulateFunction(ChunkPopulationFunction);
+    // face meshes can be patched in place when blocks are edited, G switches to greedy meshes which always remesh
+    Manager.SetMeshingMode(MeshingMode::Faces);
+    Manager.SetVertexFormat(CubeGeometryBuilder::VertexFormat::Packed);
 }
 
 void MoveCamera(ObjectTransform& transform)
@@ -94,6 +99,27 @@ void MoveCamera(ObjectTransform& transform)
         transform.MoveV(-speed);
 }
 
+void EditWorld(ObjectTransform& transform)
+{
+    // dig out or place blocks a little way in front of the camera, hold control to edit a whole ball
+    bool dig = IsMouseButtonPressed(MOUSE_BUTTON_LEFT);
+    bool fill = IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE);
+    if (!dig && !fill)
+        return;
+
+    constexpr float editDistance = 8;
+    constexpr int editRadius = 3;
+
+    Vector3 target = Vector3Add(transform.GetPosition(), Vector3Scale(transform.GetDVector(), editDistance));
+    BlockPosition center{ int64_t(floorf(target.x)), int64_t(floorf(target.z)), int64_t(floorf(target.y)) };
+
+    BlockType block = dig ? Air : Stone;
+    if (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL))
+        Map.FillSphere(center, editRadius, block);
+    else
+        Manager.SetBlock(center, block);
+}
+
 int main()
 {
     SearchAndSetResourceDir("resources");
@@ -126,17 +152,25 @@ int main()
 
     float factor = 100.0f;
     SetShaderValue(shader, fogFactorLoc, &factor, SHADER_UNIFORM_FLOAT);
+    Manager.SetFogDensity(factor);
 
     float fogColor[4] = { WHITE.r / 255.0f,WHITE.g / 255.0f,WHITE.b / 255.0f, 255};
     SetShaderValue(shader, fogColorLoc, fogColor, SHADER_UNIFORM_VEC4);
 
+    // chunk meshes give the corner of each atlas tile and the shader repeats it across merged faces
+    float tileSize[2] = { 1.0f / BlockAtlasColumns, 1.0f / BlockAtlasRows };
+    SetShaderValue(shader, GetShaderLocation(shader, "tileSize"), tileSize, SHADER_UNIFORM_VEC2);
+
+    // switched per chunk, meshes built before a format change are still drawn until they are replaced
+    auto packedVerticesLoc = GetShaderLocation(shader, "packedVertices");
+
     Lights::SetLightingShader(shader);
 
     Camera3D ViewCamera = { 0 };
     ViewCamera.fovy = 45;
     ObjectTransform CameraTransform(false);
 
-    CameraTransform.SetPosition(0, Chunk::ChunkHeight * 0.45f, -10);
+    CameraTransform.SetPosition(0, Chunk::ChunkHeight * WorldChunkLayers * 0.75f, -10);
     CameraTransform.RotateY(-45);
     CameraTransform.SetCamera(ViewCamera);
 
@@ -151,6 +185,13 @@ int main()
     while (!WindowShouldClose())
     {
         MoveCamera(CameraTransform);
+        EditWorld(CameraTransform);
+
+        if (IsKeyPressed(KEY_G))
+            Manager.SetMeshingMode(Manager.Mesher.GetMeshingMode() == MeshingMode::Greedy ? MeshingMode::Faces : MeshingMode::Greedy);
+
+        if (IsKeyPressed(KEY_R))
+            Manager.Reload();
 
         Manager.Update(CameraTransform.GetPosition());
         // drawing
@@ -164,10 +205,20 @@ int main()
 
         BeginMode3D(ViewCamera);
         Environment::DrawPreChunk(ViewCamera);
-        Manager.DoForEachRenderChunk([&cubeMat](Chunk* chunk)
+        int packedVertices = -1;
+        int trianglesDrawn = 0;
+        Vector3 cameraPosition = CameraTransform.GetPosition();
+        Manager.DoForEachRenderChunk([&cubeMat, &packedVertices, &trianglesDrawn, cameraPosition, packedVerticesLoc](Chunk* chunk)
             {                
                 constexpr float fadeSpeed = 1.0f/ 0.5f;
 
+                int packed = CubeGeometryBuilder::IsPacked(chunk->ChunkMesh) ? 1 : 0;
+                if (packed != packedVertices)
+                {
+                    packedVertices = packed;
+                    SetShaderValue(cubeMat.shader, packedVerticesLoc, &packedVertices, SHADER_UNIFORM_INT);
+                }
+
                 float color[4] = { 1,1,1,1 };
                 if (chunk->Alpha < 1)
                 {
@@ -178,7 +229,12 @@ int main()
 
                 cubeMat.maps[MATERIAL_MAP_DIFFUSE].color.a = (unsigned char)(chunk->Alpha * 255);
 
-                DrawMesh(chunk->ChunkMesh, cubeMat, MatrixTranslate(chunk->Id.Coordinate.h * float(Chunk::ChunkSize), 0, chunk->Id.Coordinate.v * float(Chunk::ChunkSize)));
+                Vector3 origin = { chunk->Id.Coordinate.h * float(Chunk::ChunkSize), chunk->Id.Coordinate.d * float(Chunk::ChunkHeight), chunk->Id.Coordinate.v * float(Chunk::ChunkSize) };
+
+                // skip the face directions that all point away from the camera, the mesh bounds are tighter than the chunk
+                uint8_t faces = CubeGeometryBuilder::GetFacesToward(Vector3Subtract(cameraPosition, origin), chunk->MeshBounds.min, chunk->MeshBounds.max);
+
+                trianglesDrawn += CubeGeometryBuilder::DrawFaces(chunk->ChunkMesh, chunk->ChunkMeshFaces, faces, cubeMat, MatrixTranslate(origin.x, origin.y, origin.z));
             });
         Environment::DrawPostChunk(ViewCamera);
         rlDrawRenderBatchActive();
@@ -194,6 +250,7 @@ int main()
         EndMode3D();
         Environment::DrawForeground(ViewCamera);
         DrawFPS(0, 0);
+        DrawText(TextFormat("Triangles %d", trianglesDrawn), 0, 20, 20, BLACK);
         Manager.DrawDebug2D();
 
         EndDrawing();
@@ -4,8 +4,62 @@
 #include "raymath.h"
 #include "rlgl.h"
 
+#include <algorithm>
+#include <math.h>
+
 using namespace Voxels;
 
+namespace
+{
+    // the planes around the visible part of the world, each as a normal pointing in and a distance
+    struct ViewFrustum
+    {
+        Vector4 Planes[6];
+
+        // from the combined view and projection matrix, with the planes of the clip space box
+        static ViewFrustum FromMatrix(const Matrix& viewProjection)
+        {
+            const Matrix& m = viewProjection;
+            Vector4 x = { m.m0, m.m4, m.m8, m.m12 };
+            Vector4 y = { m.m1, m.m5, m.m9, m.m13 };
+            Vector4 z = { m.m2, m.m6, m.m10, m.m14 };
+            Vector4 w = { m.m3, m.m7, m.m11, m.m15 };
+
+            auto add = [](const Vector4& a, const Vector4& b) { return Vector4{ a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; };
+            auto subtract = [](const Vector4& a, const Vector4& b) { return Vector4{ a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; };
+
+            ViewFrustum frustum;
+            frustum.Planes[0] = add(w, x);
+            frustum.Planes[1] = subtract(w, x);
+            frustum.Planes[2] = add(w, y);
+            frustum.Planes[3] = subtract(w, y);
+            frustum.Planes[4] = add(w, z);
+            frustum.Planes[5] = subtract(w, z);
+            return frustum;
+        }
+
+        // a box is outside when even its corner furthest along a plane's normal is behind that plane
+        bool ContainsBox(const BoundingBox& box) const
+        {
+            for (const Vector4& plane : Planes)
+            {
+                float x = plane.x > 0 ? box.max.x : box.min.x;
+                float y = plane.y > 0 ? box.max.y : box.min.y;
+                float z = plane.z > 0 ? box.max.z : box.min.z;
+                if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    float GetDistanceToBox(const Vector3& point, const BoundingBox& box)
+    {
+        Vector3 closest = Vector3Clamp(point, box.min, box.max);
+        return Vector3Distance(point, closest);
+    }
+}
+
 ChunkLoop::ChunkLoop(int size)
 {
     Size = size;
@@ -31,13 +85,13 @@ void ChunkLoop::Fill(ChunkId center)
 
     for (int i = 0; i < distance; i++)
     {
-        TopRow[i] = ChunkId(leftH + i, topV);
-        BottomRow[i] = ChunkId(leftH + i, bottomV);
+        TopRow[i] = ChunkId(leftH + i, topV, center.Coordinate.d);
+        BottomRow[i] = ChunkId(leftH + i, bottomV, center.Coordinate.d);
     }
     for (int i = 0; i < distance-2; i++)
     {
-        LeftColumn[i] = ChunkId(leftH, topV + 1 + i);
-        RightColumn[i] = ChunkId(rightH, topV + 1 + i);
+        LeftColumn[i] = ChunkId(leftH, topV + 1 + i, center.Coordinate.d);
+        RightColumn[i] = ChunkId(rightH, topV + 1 + i, center.Coordinate.d);
     }
 }
 
@@ -76,8 +130,9 @@ void ChunkManager::DrawDebugChunk(Voxels::ChunkId id, Color tint)
 {
     float h = float(id.Coordinate.h) * Chunk::ChunkSize;
     float v = float(id.Coordinate.v) * Chunk::ChunkSize;
+    float d = float(id.Coordinate.d) * Chunk::ChunkHeight;
 
-    DrawCubeWires(Vector3{ h + Chunk::ChunkSize * 0.5f, Chunk::ChunkHeight * 0.5f, v + Chunk::ChunkSize * 0.5f },
+    DrawCubeWires(Vector3{ h + Chunk::ChunkSize * 0.5f, d + Chunk::ChunkHeight * 0.5f, v + Chunk::ChunkSize * 0.5f },
         Chunk::ChunkSize - 1, Chunk::ChunkSize, Chunk::ChunkSize - 1, tint);
 }
 
@@ -89,6 +144,8 @@ void ChunkManager::DrawDebug3D()
         {
             area.DoForEach([this](ChunkId id)
                 {
+                    id = GetCenterLayerChunk(id);
+
                     bool useable = false;
                     if (Map.GetChunk(id) != nullptr)
                         useable = Map.GetChunk(id)->GetStatus() == ChunkStatus::Useable;
@@ -101,15 +158,56 @@ void ChunkManager::DrawDebug3D()
 
 void ChunkManager::DrawDebug2D()
 {
-    DrawText(TextFormat("Current Chunk h%d v%d", CurrentChunk.Coordinate.h, CurrentChunk.Coordinate.v), 10, GetScreenHeight()-40, 20, BLACK);
-    DrawText(TextFormat("Meshes %d", int(ChunksWithMeshes.size())), 10, GetScreenHeight() - 20, 20, BLACK);
+    DrawText(TextFormat("Current Chunk h%d v%d d%d", CurrentChunk.Coordinate.h, CurrentChunk.Coordinate.v, CurrentChunk.Coordinate.d), 10, GetScreenHeight()-40, 20, BLACK);
+    int vertexCount = 0;
+    for (uint64_t rawId : ChunksWithMeshes)
+    {
+        auto* chunk = Map.GetChunk(ChunkId(rawId));
+        if (chunk)
+            vertexCount += chunk->ChunkMesh.vertexCount;
+    }
+
+    const char* mode = Mesher.GetMeshingMode() == MeshingMode::Greedy ? "Greedy" : "Faces";
+    DrawText(TextFormat("Meshes %d Chunks %d Vertices %d Culled %d (%s)", int(ChunksWithMeshes.size()), int(Map.GetChunkCount()), vertexCount, CulledChunks, mode), 10, GetScreenHeight() - 20, 20, BLACK);
+}
+
+void ChunkManager::SetMeshingMode(MeshingMode mode)
+{
+    if (Mesher.GetMeshingMode() == mode)
+        return;
+
+    Mesher.SetMeshingMode(mode);
+    RemeshAll();
+}
+
+void ChunkManager::SetVertexFormat(CubeGeometryBuilder::VertexFormat format)
+{
+    if (Mesher.GetVertexFormat() == format)
+        return;
+
+    Mesher.SetVertexFormat(format);
+    RemeshAll();
+}
+
+void ChunkManager::RemeshAll()
+{
+    // everything on screen is remeshed the new way, the old meshes are drawn until then
+    for (uint64_t rawId : ChunksWithMeshes)
+    {
+        auto* chunk = Map.GetChunk(ChunkId(rawId));
+        if (chunk)
+            chunk->MarkDirty();
+    }
 }
 
 void ChunkManager::Update(const Vector3& position)
 {
     WorldSpacePosition = position;
 
-    ChunkId thisChunk(int(position.x / Chunk::ChunkSize), int(position.z / Chunk::ChunkSize));
+    // eviction ranks chunks by the last tick they were used
+    Map.AdvanceTick();
+
+    ChunkId thisChunk(int(floorf(position.x / Chunk::ChunkSize)), int(floorf(position.z / Chunk::ChunkSize)), int(floorf(position.y / Chunk::ChunkHeight)));
 
     if (!CurrentChunk.IsValid() || thisChunk.Id != CurrentChunk.Id)
     {
@@ -122,34 +220,61 @@ void ChunkManager::Update(const Vector3& position)
         for (auto& area : LoadedArea)
             area.Fill(CurrentChunk);
 
-        // validate each ring from center out to see if it's loaded
-        meshedChunks.erase(CurrentChunk.Id);
-        PendingMeshUnloads.erase(CurrentChunk.Id);
-        ValidateChunkGeneration(CurrentChunk);
+        // gather the chunks around the camera in 3d, closest first so they load first
+        // rendered columns also load one extra layer above and below so they can be meshed
+        std::vector<ChunkId> loadChunks;
+
+        RenderChunks.clear();
+        AddColumn(CurrentChunk, VerticalDistance, RenderChunks);
+        AddColumn(CurrentChunk, VerticalDistance + 1, loadChunks);
 
         for (auto& area : RenderArea)
         {
-            area.DoForEach([&](ChunkId id) 
+            area.DoForEach([&](ChunkId id)
                 {
-                    meshedChunks.erase(id.Id);
-                    PendingMeshUnloads.erase(id.Id);
-                    ValidateChunkMesh(id); 
+                    AddColumn(id, VerticalDistance, RenderChunks);
+                    AddColumn(id, VerticalDistance + 1, loadChunks);
                 });
         }
 
         for (auto& area : LoadedArea)
+            area.DoForEach([&](ChunkId id) { AddColumn(id, VerticalDistance + 1, loadChunks); });
+
+        SortByDistance(RenderChunks);
+        SortByDistance(loadChunks);
+
+        for (ChunkId id : RenderChunks)
         {
-            area.DoForEach([&](ChunkId id) 
-                {
-                    meshedChunks.erase(id.Id);
-                    PendingMeshUnloads.erase(id.Id);
-                    ValidateChunkGeneration(id);
-                });
+            meshedChunks.erase(id.Id);
+            PendingMeshUnloads.erase(id.Id);
+            ValidateChunkMesh(id);
+        }
+
+        for (ChunkId id : loadChunks)
+        {
+            meshedChunks.erase(id.Id);
+            PendingMeshUnloads.erase(id.Id);
+            ValidateChunkGeneration(id);
         }
 
         // see what chunks have left the party?
         for (auto id : meshedChunks)
             PendingMeshUnloads.insert(id);
+
+        // drop the data for chunks that are far away when the world is over budget
+        // anything inside the load area is kept, it would just be generated again
+        int32_t keepDistance = RenderDistance + LoadDistance;
+        int32_t keepLayer = GetCenterLayerChunk(CurrentChunk).Coordinate.d;
+        Map.EvictChunks(CurrentChunk, [this, keepDistance, keepLayer](const Chunk& chunk)
+            {
+                // a remesh that is building would just be thrown away
+                if (RemeshingChunks.find(chunk.Id.Id) != RemeshingChunks.end())
+                    return false;
+
+                return std::abs(int32_t(chunk.Id.Coordinate.h - CurrentChunk.Coordinate.h)) > keepDistance
+                    || std::abs(int32_t(chunk.Id.Coordinate.v - CurrentChunk.Coordinate.v)) > keepDistance
+                    || std::abs(int32_t(chunk.Id.Coordinate.d) - keepLayer) > VerticalDistance + 1;
+            });
     }
 
     ChunkId id;
@@ -158,17 +283,51 @@ void ChunkManager::Update(const Vector3& position)
         ValidateChunkMesh(id);
     }
 
+    RemeshDirtyChunks();
+
     double gpuTimeLimit = 1.0/60.0;
 
     double startTime = GetTime();
     while (GetTime() - startTime < gpuTimeLimit)
     {
-        if (Mesher.PopChunk(&id))
+        // a mesh that is not uploaded goes back to the pool when this goes out of scope
+        ChunkMeshTaskPool::CompletedMesh completed;
+        if (Mesher.PopChunk(&completed))
         {
+            id = completed.Id;
+            RemeshingChunks.erase(id.Id);
+
+            // the chunk may have been evicted, or evicted and loaded again, while the mesh was building
             auto* chunk = Map.GetChunk(id);
-            chunk->SetStatus(ChunkStatus::Useable);
-            UploadMesh(&chunk->ChunkMesh, false);
-            ChunksWithMeshes.insert(id.Id);
+            if (!completed.Built || !chunk || chunk->GetEpoch() != completed.Epoch)
+                continue;
+
+            // uploading hands the mesh buffer back to the pool
+            if (chunk->TryTransition(ChunkStatus::Meshed, ChunkStatus::Useable))
+            {
+                chunk->ChunkMeshFaces = completed.Mesh.GetFaceRanges();
+                chunk->ChunkMesh = CubeGeometryBuilder::Upload(std::move(completed.Mesh));
+                chunk->MeshFaces = std::move(completed.Faces);
+                chunk->MeshVersion = completed.Version;
+                chunk->MeshLod = completed.Lod;
+                chunk->MeshBounds = completed.Bounds;
+                ChunksWithMeshes.insert(id.Id);
+            }
+            else if (chunk->GetStatus() == ChunkStatus::Useable && int32_t(completed.Version - chunk->MeshVersion) >= 0 && completed.Version == chunk->GetVersion())
+            {
+                // swap in the remesh, the old mesh was drawn right up until now
+                chunk->ChunkMeshFaces = completed.Mesh.GetFaceRanges();
+                Mesh mesh = CubeGeometryBuilder::Upload(std::move(completed.Mesh));
+                CubeGeometryBuilder::Unload(chunk->ChunkMesh);
+                chunk->ChunkMesh = mesh;
+                chunk->MeshFaces = std::move(completed.Faces);
+                chunk->MeshVersion = completed.Version;
+                chunk->MeshLod = completed.Lod;
+                chunk->MeshBounds = completed.Bounds;
+            }
+
+            // otherwise the chunk was unloaded while the remesh was building, the drawn mesh was patched past it, or blocks
+            // changed after the remesh read them, in which case the chunk is dirty and gets remeshed again
         }
         else if (!PendingMeshUnloads.empty())
         {
@@ -179,9 +338,10 @@ void ChunkManager::Update(const Vector3& position)
             if (chunk)
             {
                 chunk->Alpha = 0;
-                UnloadMesh(chunk->ChunkMesh);
+                CubeGeometryBuilder::Unload(chunk->ChunkMesh);
                 chunk->ChunkMesh.vaoId = 0;
-                chunk->SetStatus(ChunkStatus::Generated);
+                chunk->MeshFaces.reset();
+                chunk->SetStatus(ChunkStatus::Populated);
                 ChunksWithMeshes.erase(rawId);
             }
         }
@@ -197,24 +357,114 @@ void ChunkManager::Abort()
     Builder.Abort();
     Mesher.Abort();
 
+    UnloadMeshes();
+    CubeGeometryBuilder::UnloadSharedBuffers();
+}
+
+void ChunkManager::Reload()
+{
+    // nothing may be building or meshing the chunks while the world drops them
+    Builder.Abort();
+    Mesher.Abort();
+
+    UnloadMeshes();
+    PendingMeshUnloads.clear();
+    RemeshingChunks.clear();
+    RenderChunks.clear();
+
+    Map.Reset();
+
+    // the next update fills the areas around the camera again
+    CurrentChunk = ChunkId();
+}
+
+void ChunkManager::UnloadMeshes()
+{
     for (auto& rawId : ChunksWithMeshes)
     {
         auto* chunk = Map.GetChunk(ChunkId(rawId));
         if (chunk)
         {
             chunk->Alpha = 0;
-            UnloadMesh(chunk->ChunkMesh);
+            CubeGeometryBuilder::Unload(chunk->ChunkMesh);
             chunk->ChunkMesh.vaoId = 0;
-            chunk->SetStatus(ChunkStatus::Generated);
+            chunk->MeshFaces.reset();
+            chunk->SetStatus(ChunkStatus::Populated);
         }
     }
 
     ChunksWithMeshes.clear();
 }
 
+ChunkId ChunkManager::GetCenterLayerChunk(ChunkId column) const
+{
+    int32_t d = std::clamp(int32_t(CurrentChunk.Coordinate.d), Map.GetMinChunkLayer(), Map.GetMaxChunkLayer());
+    return ChunkId(column.Coordinate.h, column.Coordinate.v, d);
+}
+
+void ChunkManager::AddColumn(ChunkId column, int verticalDistance, std::vector<ChunkId>& chunks) const
+{
+    // when the camera is above or below the world, use the closest layer in the world
+    int32_t center = GetCenterLayerChunk(column).Coordinate.d;
+
+    int32_t minD = std::max(center - verticalDistance, Map.GetMinChunkLayer());
+    int32_t maxD = std::min(center + verticalDistance, Map.GetMaxChunkLayer());
+
+    for (int32_t d = minD; d <= maxD; d++)
+        chunks.push_back(ChunkId(int32_t(column.Coordinate.h), int32_t(column.Coordinate.v), d));
+}
+
+void ChunkManager::SortByDistance(std::vector<ChunkId>& chunks) const
+{
+    // chunks are taller than they are wide, so vertical steps count for more
+    constexpr int64_t verticalScale = Chunk::ChunkHeight / Chunk::ChunkSize;
+
+    auto distance = [this](ChunkId id)
+        {
+            int64_t h = id.Coordinate.h - CurrentChunk.Coordinate.h;
+            int64_t v = id.Coordinate.v - CurrentChunk.Coordinate.v;
+            int64_t d = (id.Coordinate.d - CurrentChunk.Coordinate.d) * verticalScale;
+            return h * h + v * v + d * d;
+        };
+
+    std::stable_sort(chunks.begin(), chunks.end(), [&distance](ChunkId a, ChunkId b) { return distance(a) < distance(b); });
+}
+
+int ChunkManager::GetRing(Voxels::ChunkId id) const
+{
+    // the same square rings the render area is made of
+    return std::max(std::abs(int(id.Coordinate.h) - int(CurrentChunk.Coordinate.h)), std::abs(int(id.Coordinate.v) - int(CurrentChunk.Coordinate.v)));
+}
+
+int ChunkManager::GetLodForRing(int ring) const
+{
+    int lod = 0;
+    while (lod < ChunkMesher::MaxLod && ring > LodRings[lod])
+        lod++;
+
+    return lod;
+}
+
+int ChunkManager::GetWantedLod(Voxels::ChunkId id, int currentLod) const
+{
+    int ring = GetRing(id);
+    int lod = GetLodForRing(ring);
+
+    // more detail is picked up right away, less waits a ring so moving back and forth over a boundary does not flicker
+    if (lod > currentLod && ring <= LodRings[currentLod] + LodHysteresisRings)
+        return currentLod;
+
+    return lod;
+}
+
 void ChunkManager::ValidateChunkGeneration(Voxels::ChunkId id)
 {
+    if (Map.IsSkyChunk(id))
+        return;
+
     auto* chunk = Map.GetChunk(id);
+    if (chunk)
+        Map.TouchChunk(*chunk);
 
     if (!chunk || chunk->GetStatus() == ChunkStatus::Empty)
     {
@@ -224,32 +474,158 @@ void ChunkManager::ValidateChunkGeneration(Voxels::ChunkId id)
 
 void ChunkManager::ValidateChunkMesh(Voxels::ChunkId id)
 {
+    if (Map.IsSkyChunk(id))
+        return;
+
     auto* chunk = Map.GetChunk(id);
+    if (chunk)
+        Map.TouchChunk(*chunk);
 
     if (!chunk || chunk->GetStatus() == ChunkStatus::Empty)
     {
         Builder.PushChunk(id);
     }
-    else if (chunk->GetStatus() < ChunkStatus::Meshing)
+    else if (RemeshingChunks.find(id.Id) == RemeshingChunks.end() && chunk->TryTransition(ChunkStatus::Populated, ChunkStatus::Meshing))
     {
-        chunk->SetStatus(ChunkStatus::Meshing);
-        Mesher.PushChunk(id);
+        // a chunk unloaded while a remesh was building waits for it to come back, the mesher marks it dirty
+        // when it drops that remesh and RemeshDirtyChunks queues it again
+        Mesher.PushChunk(id, chunk->GetEpoch(), false, GetLodForRing(GetRing(id)));
     }
 }
-void ChunkManager::DoForEachRenderChunk(std::function<void(Voxels::Chunk*)> func)
+void ChunkManager::SetBlock(const BlockPosition& position, BlockType block)
 {
-    Chunk* chunk = Map.GetChunk(CurrentChunk);
-    if (chunk && chunk->GetStatus() == ChunkStatus::Useable)
-        func(chunk);
+    // the block itself and the six blocks around it can gain or lose faces
+    static constexpr int Offsets[7][3] =
+    {
+        { 0, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
 
-    for (auto& area : RenderArea)
+    auto getPosition = [&position](const int* offset)
+        {
+            return BlockPosition{ position.H + offset[0], position.V + offset[1], position.D + offset[2] };
+        };
+
+    // nothing changes, and the dirty counts below assume the edit writes the block
+    ChunkId editId = World::GetChunkIdForBlock(position);
+    BlockPosition editOrigin = World::GetChunkOrigin(editId);
+    if (Map.GetVoxel(editId, int(position.H - editOrigin.H), int(position.V - editOrigin.V), int(position.D - editOrigin.D)) == block)
+        return;
+
+    // chunks that already need a remesh, or have one building, will pick this edit up from the remesh
+    // the dirty count of each is kept so marks from other threads during the edit are not cleared with it
+    std::unordered_map<uint64_t, uint32_t> patchChunks;
+    for (auto& offset : Offsets)
     {
-        area.DoForEach([this, func](ChunkId id) 
-            {
-                Chunk* chunk = Map.GetChunk(id);
-                if (chunk && chunk->GetStatus() == ChunkStatus::Useable)
-                    func(chunk);
-            });
+        ChunkId id = World::GetChunkIdForBlock(getPosition(offset));
+        auto* chunk = Map.GetChunk(id);
+        if (chunk && chunk->GetStatus() == ChunkStatus::Useable && !chunk->IsDirty() && RemeshingChunks.find(id.Id) == RemeshingChunks.end())
+            patchChunks[id.Id] = chunk->GetDirtyCount();
+    }
+
+    DirtyChunkSet dirtyChunks;
+    Map.SetVoxel(position, block, &dirtyChunks);
+
+    std::set<uint64_t> failedChunks;
+    for (auto& offset : Offsets)
+    {
+        BlockPosition blockPosition = getPosition(offset);
+        ChunkId id = World::GetChunkIdForBlock(blockPosition);
+        if (patchChunks.find(id.Id) == patchChunks.end())
+            continue;
+
+        BlockPosition origin = World::GetChunkOrigin(id);
+        auto* chunk = Map.GetChunk(id);
+        if (ChunkMesher::PatchBlock(Map, *chunk, int(blockPosition.H - origin.H), int(blockPosition.V - origin.V), int(blockPosition.D - origin.D)))
+            chunk->MeshVersion = chunk->GetVersion();
+        else
+            failedChunks.insert(id.Id);
+    }
+
+    // patched meshes are up to date, anything that could not be patched stays dirty and gets remeshed
+    // the edit marked each chunk in the dirty set once, and the edited chunk once more when its block was written,
+    // any other mark came from somewhere else and keeps the chunk dirty
+    for (auto& [rawId, dirtyCount] : patchChunks)
+    {
+        if (failedChunks.find(rawId) != failedChunks.end())
+            continue;
+
+        uint32_t editMarks = 0;
+        if (dirtyChunks.find(rawId) != dirtyChunks.end())
+            editMarks = rawId == editId.Id ? 2 : 1;
+
+        Map.GetChunk(ChunkId(rawId))->ClearDirty(dirtyCount + editMarks);
     }
 }
 
+void ChunkManager::RemeshDirtyChunks()
+{
+    for (ChunkId id : RenderChunks)
+    {
+        if (RemeshingChunks.find(id.Id) != RemeshingChunks.end())
+            continue;
+
+        auto* chunk = Map.GetChunk(id);
+        if (!chunk)
+            continue;
+
+        // chunks built into open sky start out populated, so edits to them need a first mesh instead of a remesh
+        if (chunk->GetStatus() == ChunkStatus::Populated && chunk->IsDirty())
+        {
+            ValidateChunkMesh(id);
+            continue;
+        }
+
+        if (chunk->GetStatus() != ChunkStatus::Useable)
+            continue;
+
+        // chunks that crossed a level of detail boundary are remeshed like dirty ones, the old mesh is drawn until then
+        int lod = GetWantedLod(id, chunk->MeshLod);
+        if (!chunk->IsDirty() && lod == chunk->MeshLod)
+            continue;
+
+        RemeshingChunks.insert(id.Id);
+        Mesher.PushChunk(id, chunk->GetEpoch(), true, lod);
+    }
+}
+
+void ChunkManager::SetFogDensity(float density)
+{
+    // the shader's fog factor is 1 / exp((distance / density)^2), past this it is under 1/255 and the fog color is all that shows
+    FogDistance = density > 0 ? density * sqrtf(logf(255.0f)) : 0;
+}
+
+void ChunkManager::DoForEachRenderChunk(std::function<void(Voxels::Chunk*)> func)
+{
+    // the camera matrices set up by BeginMode3D
+    ViewFrustum frustum = ViewFrustum::FromMatrix(MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+
+    // the render area is a square, so past the circle that fits in it there are only chunks in the corners
+    // those are culled so the area ends the same distance out in every direction
+    // with the demo's fog density the fog distance is past the corners and the render range does the culling
+    float maxDrawDistance = RenderDistance * float(Chunk::ChunkSize);
+    if (FogDistance > 0)
+        maxDrawDistance = std::min(maxDrawDistance, FogDistance);
+
+    CulledChunks = 0;
+    for (ChunkId id : RenderChunks)
+    {
+        Chunk* chunk = Map.GetChunk(id);
+        if (!chunk || chunk->GetStatus() != ChunkStatus::Useable)
+            continue;
+
+        // culled chunks are still in range, so they count as used too
+        Map.TouchChunk(*chunk);
+
+        Vector3 origin = { id.Coordinate.h * float(Chunk::ChunkSize), id.Coordinate.d * float(Chunk::ChunkHeight), id.Coordinate.v * float(Chunk::ChunkSize) };
+        BoundingBox bounds = { Vector3Add(chunk->MeshBounds.min, origin), Vector3Add(chunk->MeshBounds.max, origin) };
+
+        bool tooFar = GetDistanceToBox(WorldSpacePosition, bounds) > maxDrawDistance;
+        if (tooFar || !frustum.ContainsBox(bounds))
+        {
+            CulledChunks++;
+            continue;
+        }
+
+        func(chunk);
+    }
+}
@@ -2,33 +2,34 @@
 
 #include "external/stb_perlin.h"
 
+#include <algorithm>
+
 using namespace Voxels;
 
 void SetupWorldData(Texture2D& texture)
 {
-    float blockWidth = 1.0f / 8.0f;
-    float blockHeight = 1.0f/2.0f;
-
-    SetBlockInfo(Air, Rectangle{ 0,0,0,0 }, false);
-    SetBlockInfo(Grass, Rectangle{ blockWidth * 2,0,blockWidth * 3,blockHeight }, Rectangle{ 0,0,blockWidth,blockHeight }, Rectangle{ blockWidth,0,blockWidth * 2,blockHeight });
-    SetBlockInfo(Dirt, Rectangle{ blockWidth,0,blockWidth * 2,blockHeight });
-    SetBlockInfo(Stone, Rectangle{ blockWidth * 3,0,blockWidth * 4,blockHeight });
-    SetBlockInfo(Bedrock, Rectangle{ blockWidth * 4,0,blockWidth * 5,blockHeight });
-
-    SetBlockInfo(Gold, Rectangle{ blockWidth * 5,0,blockWidth * 6,blockHeight });
-    SetBlockInfo(Copper, Rectangle{ blockWidth * 6,0,blockWidth * 7,blockHeight });
-
-    SetBlockInfo(Tree, Rectangle{ 0, blockHeight, blockWidth * 1, blockHeight*2 }, Rectangle{ blockWidth * 1, blockHeight,blockWidth * 2, blockHeight * 2 });
-    SetBlockInfo(Leaves, Rectangle{ blockWidth * 2, blockHeight,blockWidth * 3, blockHeight*2 });
-
-    constexpr int chunkCount = 5;
+    BlockRegistry::SetBlocks(BlockDefinitions, sizeof(BlockDefinitions) / sizeof(BlockDefinitions[0]), BlockAtlasColumns, BlockAtlasRows);
+    BlockRegistry::Freeze();
 }
 
-void ChunkPopulationFunction(Voxels::Chunk& chunk)
+void ChunkPopulationFunction(Voxels::World& world, Voxels::Chunk& chunk)
 {
     int32_t chunkH = chunk.Id.Coordinate.h;
     int32_t chunkV = chunk.Id.Coordinate.v;
 
+    BlockPosition origin = World::GetChunkOrigin(chunk.Id);
+
+    // tree blocks past the top of this layer go into the chunk above, population waits for it to be generated
+    // and the world edit adds it if it is open sky
+    // the edit marks that chunk dirty, so one that is already drawn is remeshed and a new one gets its first mesh
+    auto setVoxel = [&](int h, int v, int d, BlockType block)
+        {
+            if (d < Chunk::ChunkHeight)
+                chunk.SetVoxel(h, v, d, block);
+            else
+                world.SetVoxel(BlockPosition{ origin.H + h, origin.V + v, origin.D + d }, block);
+        };
+
     for (int v = 0; v < Chunk::ChunkSize; v++)
     {
         for (int h = 0; h < Chunk::ChunkSize; h++)
@@ -41,13 +42,13 @@ void ChunkPopulationFunction(Voxels::Chunk& chunk)
             if (stb_perlin_fbm_noise3(worldH * hvScale, worldV * hvScale, 1.0f, 3.0f, 1.5f, 2) > 1.3f)
             {
                 int d = chunk.GetTopBlockDepth(h, v);
-                if (chunk.GetVoxel(h, v, d) == Grass)
+                if (d >= 0 && chunk.GetVoxel(h, v, d) == Grass)
                 {
                     for (int treeD = 0; treeD < 4; treeD++)
                     {
-                        chunk.SetVoxel(h, v, d + 1 + treeD, Tree);
+                        setVoxel(h, v, d + 1 + treeD, Tree);
                     }
-                    chunk.SetVoxel(h, v, d + 1 + 4, Leaves);
+                    setVoxel(h, v, d + 1 + 4, Leaves);
                 }
             }
         }
@@ -59,6 +60,28 @@ void ChunkGenerationFunction(Voxels::Chunk& chunk)
     int32_t chunkH = chunk.Id.Coordinate.h;
     int32_t chunkV = chunk.Id.Coordinate.v;
 
+    // terrain is described in world depth, each chunk layer covers a slice of it
+    int worldDBase = int(chunk.Id.Coordinate.d) * Chunk::ChunkHeight;
+
+    // generate into a flat buffer and encode it into the chunk in one pass
+    static thread_local BlockType blocks[Chunk::BlockCount];
+    std::fill(blocks, blocks + Chunk::BlockCount, Air);
+
+    auto setVoxel = [worldDBase](int h, int v, int d, BlockType block)
+        {
+            d -= worldDBase;
+            if (d >= 0 && d < Chunk::ChunkHeight)
+                blocks[Chunk::GetIndex(h, v, d)] = block;
+        };
+
+    auto getVoxel = [worldDBase](int h, int v, int d)
+        {
+            d -= worldDBase;
+            if (d < 0 || d >= Chunk::ChunkHeight)
+                return InvalidBlock;
+            return blocks[Chunk::GetIndex(h, v, d)];
+        };
+
     for (int v = 0; v < Chunk::ChunkSize; v++)
     {
         for (int h = 0; h < Chunk::ChunkSize; h++)
@@ -68,18 +91,22 @@ void ChunkGenerationFunction(Voxels::Chunk& chunk)
             int64_t worldH = (h + (chunkH * Chunk::ChunkSize));
             int64_t worldV = (v + (chunkV * Chunk::ChunkSize));
 
-            int depthLimit = 8 + int((stb_perlin_fbm_noise3(worldH * hvScale, worldV * hvScale, 1.0f, 2.0f, 0.5f, 6) + 1) * 0.5f * 16);
+            int depthLimit = 8 + int((stb_perlin_fbm_noise3(worldH * hvScale, worldV * hvScale, 1.0f, 2.0f, 0.5f, 6) + 1) * 0.5f * TerrainHeightRange);
+
+            // nothing in this column reaches the chunk
+            if (depthLimit <= worldDBase)
+                continue;
 
-            for (int d = 0; d < depthLimit; d++)
+            for (int d = worldDBase; d < std::min(depthLimit, worldDBase + Chunk::ChunkHeight); d++)
             {
                 if (d == 0)
-                    chunk.SetVoxel(h, v, d, Bedrock);
+                    setVoxel(h, v, d, Bedrock);
                 else if (d < 4)
-                    chunk.SetVoxel(h, v, d, Stone);
+                    setVoxel(h, v, d, Stone);
                 else if (d == depthLimit - 1)
-                    chunk.SetVoxel(h, v, d, Grass);
+                    setVoxel(h, v, d, Grass);
                 else
-                    chunk.SetVoxel(h, v, d, Dirt);
+                    setVoxel(h, v, d, Dirt);
             }
 
             float limit = 0.5f;
@@ -95,7 +122,7 @@ void ChunkGenerationFunction(Voxels::Chunk& chunk)
 
                 for (int d = min; d <= max; d++)
                 {
-                    chunk.SetVoxel(h, v, d, Air);
+                    setVoxel(h, v, d, Air);
                 }
             }
 
@@ -107,33 +134,33 @@ void ChunkGenerationFunction(Voxels::Chunk& chunk)
             if (oreFactor > limit)
             {
                 int height = 8 + oreHeight * 3;
-                if (chunk.GetVoxel(h, v, height) != Air)
+                if (getVoxel(h, v, height) != Air)
                 {
-                    chunk.SetVoxel(h, v, height, Gold);
+                    setVoxel(h, v, height, Gold);
                 }
             }
             else if(oreFactor < -limit)
             {
                 int height = 10 + oreHeight;
-                if (chunk.GetVoxel(h, v, height) != Air)
+                if (getVoxel(h, v, height) != Air)
                 {
-                    chunk.SetVoxel(h, v, height, Copper);
+                    setVoxel(h, v, height, Copper);
                 }
             }
 
-            for (int d = Chunk::ChunkHeight-2; d > 0; d--)
+            for (int d = worldDBase + Chunk::ChunkHeight - 1; d > std::max(0, worldDBase); d--)
             {
-                if (chunk.GetVoxel(h, v, d) == Grass)
+                if (getVoxel(h, v, d) == Grass)
                 {
-                    if (chunk.GetVoxel(h, v, d - 1) == Air)
+                    if (getVoxel(h, v, d - 1) == Air)
                     {
-                        chunk.SetVoxel(h, v, d, Air);
-                        chunk.SetVoxel(h, v, d-1, Grass);
+                        setVoxel(h, v, d, Air);
+                        setVoxel(h, v, d-1, Grass);
                     }
                 }
             }
         }
     }
 
-    chunk.SetStatus(ChunkStatus::Generated);
+    chunk.SetBlocks(blocks);
 }
@@ -31,6 +31,35 @@ newoption
     default = "opengl33"
 }
 
+newoption
+{
+    trigger = "chunk_layout",
+    value = "LAYOUT",
+    description = "order of the blocks inside a voxel chunk section",
+    allowed = {
+        { "ymajor", "Horizontal layers of rows"},
+        { "column", "Vertical columns"},
+        { "morton", "Morton (Z-order) curve"}
+    },
+    default = "ymajor"
+}
+
+newoption
+{
+    trigger = "chunk_size",
+    value = "BLOCKS",
+    description = "width and depth of a voxel chunk in blocks",
+    default = "16"
+}
+
+newoption
+{
+    trigger = "chunk_height",
+    value = "BLOCKS",
+    description = "height of a voxel chunk in blocks, must be a multiple of 8 and at most 64",
+    default = "32"
+}
+
 function string.starts(String,Start)
     return string.sub(String,1,string.len(Start))==Start
 end
@@ -85,6 +114,15 @@ workspace (workspaceName)
         defines { "NDEBUG" }
         optimize "On"
 
+    filter "options:chunk_layout=column"
+        defines { "VOXEL_CHUNK_LAYOUT=ColumnMajorLayout" }
+
+    filter "options:chunk_layout=morton"
+        defines { "VOXEL_CHUNK_LAYOUT=MortonLayout" }
+
+    filter {}
+        defines { "VOXEL_CHUNK_SIZE=" .. (_OPTIONS["chunk_size"] or "16"), "VOXEL_CHUNK_HEIGHT=" .. (_OPTIONS["chunk_height"] or "32") }
+
     filter { "platforms:x64" }
         architecture "x86_64"
 
@@ -3,6 +3,7 @@
 // Input vertex attributes (from vertex shader)
 in vec3 fragPosition;
 in vec2 fragTexCoord;
+in vec2 fragTileCoord;
 in vec4 fragColor;
 in vec3 fragNormal;
 
@@ -10,6 +11,9 @@ in vec3 fragNormal;
 uniform sampler2D texture0;
 uniform vec4 colDiffuse;
 
+// size of one atlas tile, fragTexCoord is the tile corner and fragTileCoord counts blocks across the face
+uniform vec2 tileSize;
+
 uniform vec4 fogColor;
 uniform float fogDensity;
 
@@ -42,7 +46,10 @@ uniform vec3 viewPos;
 void main()
 {
     // Texel color fetching from texture sampler
-    vec4 texelColor = texture(texture0, fragTexCoord);
+    // merged faces repeat the tile once per block, the gradients come from the unwrapped coordinates so mips don't jump at the seams
+    vec2 tileCoord = fragTileCoord * tileSize;
+    vec2 uv = fragTexCoord + fract(fragTileCoord) * tileSize;
+    vec4 texelColor = textureGrad(texture0, uv, dFdx(tileCoord), dFdy(tileCoord));
     vec3 lightDot = vec3(0.0);
     vec3 normal = normalize(fragNormal);
     vec3 viewD = normalize(viewPos - fragPosition);
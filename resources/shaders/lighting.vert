@@ -1,8 +1,9 @@
 #version 330
 
 // Input vertex attributes
-in vec3 vertexPosition;
+in vec4 vertexPosition;
 in vec2 vertexTexCoord;
+in vec2 vertexTexCoord2;
 in vec3 vertexNormal;
 in vec4 vertexColor;
 
@@ -11,9 +12,17 @@ uniform mat4 mvp;
 uniform mat4 matModel;
 uniform mat4 matNormal;
 
+// chunk meshes can pack each vertex into two words of bytes
+// vertexPosition holds the position and face index and vertexColor the atlas tile and the position on the face
+uniform int packedVertices;
+uniform vec2 tileSize;
+
+const vec3 faceNormals[6] = vec3[6](vec3(0, 0, 1), vec3(0, 0, -1), vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0));
+
 // Output vertex attributes (to fragment shader)
 out vec3 fragPosition;
 out vec2 fragTexCoord;
+out vec2 fragTileCoord;
 out vec4 fragColor;
 out vec3 fragNormal;
 
@@ -21,12 +30,24 @@ out vec3 fragNormal;
 
 void main()
 {
-    // Send vertex attributes to fragment shader
-    fragPosition = vec3(matModel*vec4(vertexPosition, 1.0));
+    vec3 position = vertexPosition.xyz;
+    vec3 normal = vertexNormal;
     fragTexCoord = vertexTexCoord;
+    fragTileCoord = vertexTexCoord2;
     fragColor = vertexColor;
-    fragNormal = normalize(vec3(matNormal*vec4(vertexNormal, 1.0)));
+
+    if (packedVertices == 1)
+    {
+        normal = faceNormals[int(vertexPosition.w)];
+        fragTexCoord = vertexColor.xy * tileSize;
+        fragTileCoord = vertexColor.zw;
+        fragColor = vec4(1.0);
+    }
+
+    // Send vertex attributes to fragment shader
+    fragPosition = vec3(matModel*vec4(position, 1.0));
+    fragNormal = normalize(vec3(matNormal*vec4(normal, 1.0)));
 
     // Calculate final vertex position
-    gl_Position = mvp*vec4(vertexPosition, 1.0);
+    gl_Position = mvp*vec4(position, 1.0);
 }
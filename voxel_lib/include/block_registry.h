@@ -0,0 +1,120 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "raylib.h"
+
+#include "block_storage.h"
+
+#include <bitset>
+
+namespace Voxels
+{
+    // indexes for the 6 faces of a cube
+    static constexpr int SouthFace = 0;
+    static constexpr int NorthFace = 1;
+    static constexpr int WestFace = 2;
+    static constexpr int EastFace = 3;
+    static constexpr int UpFace = 4;
+    static constexpr int DownFace = 5;
+
+    // compile time description of a block type
+    // tiles are cells in a grid texture atlas, counted from the top left
+    struct BlockDefinition
+    {
+        BlockType BlockID = InvalidBlock;
+        uint8_t SideTileX = 0;
+        uint8_t SideTileY = 0;
+        uint8_t TopTileX = 0;
+        uint8_t TopTileY = 0;
+        uint8_t BottomTileX = 0;
+        uint8_t BottomTileY = 0;
+        bool Solid = true;
+        bool Opaque = true;
+
+        static constexpr BlockDefinition Open(BlockType id)
+        {
+            return BlockDefinition{ id, 0, 0, 0, 0, 0, 0, false, false };
+        }
+
+        static constexpr BlockDefinition Cube(BlockType id, uint8_t tileX, uint8_t tileY)
+        {
+            return BlockDefinition{ id, tileX, tileY, tileX, tileY, tileX, tileY, true, true };
+        }
+
+        static constexpr BlockDefinition Column(BlockType id, uint8_t sideX, uint8_t sideY, uint8_t topX, uint8_t topY)
+        {
+            return BlockDefinition{ id, sideX, sideY, topX, topY, sideX, sideY, true, true };
+        }
+
+        static constexpr BlockDefinition Sided(BlockType id, uint8_t sideX, uint8_t sideY, uint8_t topX, uint8_t topY, uint8_t bottomX, uint8_t bottomY)
+        {
+            return BlockDefinition{ id, sideX, sideY, topX, topY, bottomX, bottomY, true, true };
+        }
+    };
+
+    // a cell in the atlas grid, used by packed vertices instead of UVs
+    struct AtlasTile
+    {
+        uint8_t X = 0;
+        uint8_t Y = 0;
+    };
+
+    // flat table of block properties indexed directly by block type
+    // it is filled out during setup and frozen before any worker threads read from it
+    // face UVs use x,y for the top left corner and width,height for the bottom right corner
+    class BlockRegistry
+    {
+    public:
+        static constexpr size_t MaxBlocks = 256;
+
+        static void SetBlock(BlockType blockId, const Rectangle faceUVs[6], bool solid = true, bool opaque = true);
+        static void SetBlocks(const BlockDefinition* definitions, size_t count, int atlasColumns, int atlasRows);
+
+        // no more changes are allowed after this
+        static void Freeze();
+        static bool IsFrozen() { return Frozen; }
+
+        static bool IsDefined(BlockType block) { return Defined[block]; }
+        static bool IsSolid(BlockType block) { return Solid[block]; }
+        static bool IsOpaque(BlockType block) { return Opaque[block]; }
+
+        static const Rectangle* GetFaceUVs(BlockType block) { return FaceUVs[block]; }
+        static const AtlasTile* GetFaceTiles(BlockType block) { return FaceTiles[block]; }
+
+    private:
+        static inline std::bitset<MaxBlocks> Defined;
+
+        // blocks that were never set are solid and opaque, so stray ids never open holes in meshes or collision
+        // the empty block is open until it is set, empty sections and sky chunks are made of it
+        static inline std::bitset<MaxBlocks> Solid = std::bitset<MaxBlocks>().set().reset(EmptyBlock);
+        static inline std::bitset<MaxBlocks> Opaque = std::bitset<MaxBlocks>().set().reset(EmptyBlock);
+
+        static inline Rectangle FaceUVs[MaxBlocks][6] = {};
+        static inline AtlasTile FaceTiles[MaxBlocks][6] = {};
+
+        // the grid size from SetBlocks, blocks set with raw UVs are snapped to it
+        static inline int AtlasColumns = 1;
+        static inline int AtlasRows = 1;
+
+        static inline bool Frozen = false;
+    };
+}
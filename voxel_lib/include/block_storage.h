@@ -0,0 +1,106 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+namespace Voxels
+{
+    using BlockType = uint8_t;
+    static constexpr BlockType InvalidBlock = BlockType(-1);
+
+    // the block new chunks and open sky are filled with
+    static constexpr BlockType EmptyBlock = 0;
+
+    // stores a fixed number of blocks as indexes into a small palette of block types
+    // the index width grows (0/1/2/4/8 bits) as new types are added, so a chunk that
+    // only uses a few block types takes a fraction of the memory of a flat array
+    class PalettedBlockStorage
+    {
+    public:
+        PalettedBlockStorage(size_t blockCount, BlockType fill = 0);
+
+        BlockType Get(size_t index) const;
+        void Set(size_t index, BlockType block);
+
+        // sets every block to one type and drops the index data
+        void Fill(BlockType block);
+
+        // write count blocks at start, start + stride, start + 2 * stride...
+        // the palette is grown once for the whole run, and runs with a stride of 1 are written a word at a time
+        // SetRun skips InvalidBlock entries
+        void FillRun(size_t start, size_t stride, size_t count, BlockType block);
+        void SetRun(size_t start, size_t stride, size_t count, const BlockType* blocks);
+
+        // true if every block is the same type, the palette can still list types that are no longer used
+        bool IsSingleType(BlockType* block = nullptr) const;
+
+        // bulk paths, the buffers must hold GetBlockCount() blocks
+        void Decode(BlockType* blocks) const;
+        void Encode(const BlockType* blocks);
+
+        size_t GetBlockCount() const { return BlockCount; }
+        uint8_t GetBitsPerBlock() const { return BitsPerBlock; }
+        const std::vector<BlockType>& GetPalette() const { return Palette; }
+
+        size_t GetMemoryUsage() const;
+
+    private:
+        size_t BlockCount = 0;
+        uint8_t BitsPerBlock = 0;
+
+        std::vector<BlockType> Palette;
+        std::vector<uint32_t> Words;
+
+        int FindPaletteIndex(BlockType block) const;
+        int AddPaletteIndex(BlockType block);
+        uint32_t RepeatIndex(uint32_t value) const;
+        uint32_t GetIndex(size_t index) const;
+        void SetIndex(size_t index, uint32_t value);
+
+        void Repack(uint8_t bits);
+
+        static uint8_t GetBitsForPaletteSize(size_t size);
+    };
+
+    // a horizontal slab of a chunk
+    // sections that are all one block type are shared immutable singletons and are
+    // replaced with a private copy by the chunk the first time a different type is written
+    class ChunkSection
+    {
+    public:
+        ChunkSection(size_t blockCount, BlockType fill);
+
+        PalettedBlockStorage Blocks;
+
+        bool IsShared() const { return Shared; }
+        bool IsUniform() const { return Blocks.GetBitsPerBlock() == 0; }
+        BlockType GetUniformBlock() const { return Blocks.GetPalette()[0]; }
+
+        static const std::shared_ptr<ChunkSection>& GetUniform(BlockType block);
+
+    private:
+        bool Shared = false;
+    };
+}
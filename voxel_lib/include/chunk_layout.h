@@ -0,0 +1,133 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+// compile time chunk shape and block order
+// these are set from premake with --chunk_size, --chunk_height and --chunk_layout
+#ifndef VOXEL_CHUNK_SIZE
+#define VOXEL_CHUNK_SIZE 16
+#endif
+
+#ifndef VOXEL_CHUNK_HEIGHT
+#define VOXEL_CHUNK_HEIGHT 32
+#endif
+
+#ifndef VOXEL_CHUNK_LAYOUT
+#define VOXEL_CHUNK_LAYOUT YMajorLayout
+#endif
+
+namespace Voxels
+{
+    // layout policies map a block inside a box of Size x Size x Height to an offset
+    // they are used for each section of a chunk, so Height is the section height
+
+    // horizontal layers of rows, h changes fastest
+    template<int Size, int Height>
+    struct YMajorLayout
+    {
+        static constexpr int GetIndex(int h, int v, int d)
+        {
+            return (d * Size * Size) + (v * Size) + h;
+        }
+    };
+
+    // vertical columns, d changes fastest so column scans are contiguous
+    template<int Size, int Height>
+    struct ColumnMajorLayout
+    {
+        static constexpr int GetIndex(int h, int v, int d)
+        {
+            return (((v * Size) + h) * Height) + d;
+        }
+    };
+
+    namespace LayoutDetail
+    {
+        constexpr int BitsFor(int value)
+        {
+            int bits = 0;
+            while ((1 << bits) < value)
+                bits++;
+            return bits;
+        }
+
+        // the bits of each axis always land in the same output bits, so each axis gets a table
+        template<int Size, int Height>
+        struct MortonTables
+        {
+            int H[Size] = {};
+            int V[Size] = {};
+            int D[Height] = {};
+        };
+
+        template<int Size, int Height>
+        constexpr MortonTables<Size, Height> BuildMortonTables()
+        {
+            MortonTables<Size, Height> tables;
+
+            const int sizeBits = BitsFor(Size);
+            const int heightBits = BitsFor(Height);
+            const int maxBits = sizeBits > heightBits ? sizeBits : heightBits;
+
+            int outBit = 0;
+            for (int bit = 0; bit < maxBits; bit++)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    int axisBits = axis == 2 ? heightBits : sizeBits;
+                    if (bit >= axisBits)
+                        continue;
+
+                    int count = axis == 2 ? Height : Size;
+                    for (int i = 0; i < count; i++)
+                    {
+                        if ((i & (1 << bit)) == 0)
+                            continue;
+
+                        if (axis == 0)
+                            tables.H[i] |= 1 << outBit;
+                        else if (axis == 1)
+                            tables.V[i] |= 1 << outBit;
+                        else
+                            tables.D[i] |= 1 << outBit;
+                    }
+                    outBit++;
+                }
+            }
+            return tables;
+        }
+
+        template<int Size, int Height>
+        inline constexpr MortonTables<Size, Height> Morton = BuildMortonTables<Size, Height>();
+    }
+
+    // Z-order curve, keeps blocks that are near each other in all 3 axes close in memory
+    template<int Size, int Height>
+    struct MortonLayout
+    {
+        static_assert((Size & (Size - 1)) == 0 && (Height & (Height - 1)) == 0, "Morton layout needs power of two dimensions");
+
+        static constexpr int GetIndex(int h, int v, int d)
+        {
+            return LayoutDetail::Morton<Size, Height>.H[h] | LayoutDetail::Morton<Size, Height>.V[v] | LayoutDetail::Morton<Size, Height>.D[d];
+        }
+    };
+}
@@ -2,14 +2,76 @@
 
 #include "geometry_builder.h"
 #include "voxel_lib.h"
+#include "chunk_neighborhood.h"
 
+#include <algorithm>
 #include <mutex>
 #include <thread>
 #include <deque>
 #include <list>
+#include <memory>
+#include <vector>
 
 namespace Voxels
 {
+    // maps each block face in a chunk mesh to the quad slot that draws it
+    // entries are kept sorted by face direction, column and depth, the order the mesher adds them in,
+    // so building the index only appends and lookups are a binary search
+    // meshes are built with some empty slots at the end so patches have room to add faces
+    // slots freed inside a face direction's range are only reused for that direction, so the ranges stay correct
+    class ChunkFaceIndex
+    {
+    public:
+        static constexpr uint32_t NoSlot = uint32_t(-1);
+
+        uint32_t Find(int h, int v, int d, int face) const;
+        void Set(int h, int v, int d, int face, uint32_t slot);
+        void Remove(int h, int v, int d, int face);
+
+        void Reserve(size_t faces) { Entries.reserve(faces); }
+
+        // the spare slots at the end of the mesh, they can hold a face of any direction
+        void AddFreeSlots(uint32_t first, uint32_t count);
+
+        // takes a freed slot from the face's own range first, then a spare one
+        uint32_t TakeFreeSlot(int face);
+        void FreeSlot(uint32_t slot, int face) { FreeSlots[slot >= FirstSpareSlot ? MeshFaceRanges::AnyFace : face].push_back(slot); }
+
+        size_t GetFreeSlotCount(int face) const { return FreeSlots[face].size(); }
+        size_t GetSpareSlotCount() const { return FreeSlots[MeshFaceRanges::AnyFace].size(); }
+
+        // how many spare slots the mesh was built with, used or not
+        uint32_t GetSparePoolSize() const { return SparePoolSize; }
+
+    private:
+        static uint32_t GetKey(int h, int v, int d, int face)
+        {
+            return (uint32_t((face * Chunk::ChunkSize + v) * Chunk::ChunkSize + h) * Chunk::ChunkHeight) + uint32_t(d);
+        }
+
+        struct Entry
+        {
+            uint32_t Key = 0;
+            uint32_t Slot = NoSlot;
+        };
+
+        // removed faces keep their entry with NoSlot, so patches only insert the first time a face shows up
+        std::vector<Entry> Entries;
+        std::vector<uint32_t> FreeSlots[MeshFaceRanges::RangeCount];
+        uint32_t FirstSpareSlot = uint32_t(-1);
+        uint32_t SparePoolSize = 0;
+
+        std::vector<Entry>::const_iterator FindEntry(uint32_t key) const;
+    };
+
+    enum class MeshingMode
+    {
+        // one quad per visible block face, these meshes can be patched in place
+        Faces,
+        // coplanar faces of the same block are merged into larger quads, edits always remesh
+        Greedy,
+    };
+
     class ChunkMesher
     {
     public:
@@ -20,11 +82,41 @@ namespace Voxels
             Built,
         };
 
-        ChunkMesher(World& world, ChunkId chunk);
+        // lod 0 is full detail, each level above that halves the resolution of the mesh
+        ChunkMesher(World& world, ChunkId chunk, MeshingMode mode = MeshingMode::Faces, CubeGeometryBuilder::VertexFormat format = CubeGeometryBuilder::VertexFormat::Float, int lod = 0);
+
+        static constexpr int MaxLod = 2;
+
+        // the size in blocks of the cells a mesh at a level of detail is built from
+        // levels that would not divide the chunk evenly use the next finer one
+        static constexpr int GetLodScale(int lod)
+        {
+            int scale = 1 << (lod < 0 ? 0 : (lod > MaxLod ? MaxLod : lod));
+            while (Chunk::ChunkSize % scale != 0 || Chunk::ChunkHeight % scale != 0)
+                scale /= 2;
+            return scale;
+        }
 
         void BuildMesh();
 
-        Mesh GetMesh();
+        // hands the built mesh to the caller, the mesher is left without one
+        MeshBuffer TakeMesh() { return std::move(ChunkMesh); }
+        std::shared_ptr<ChunkFaceIndex> GetFaceIndex() const { return FaceIndex; }
+
+        // the chunk version the mesh was built from
+        uint32_t GetBlockVersion() const { return Neighborhood.GetVersion(); }
+        int GetLod() const { return Lod; }
+
+        // chunk local box around the built mesh, the full chunk across and only as tall as the solid blocks
+        BoundingBox GetMeshBounds() const { return MeshBounds; }
+
+        // how many spare quads a face mesh is built with, see Chunk::MeshSpareFaces
+        void SetSpareFaces(int count) { SpareFaces = GetSpareFaceCount(count); }
+
+        // rewrites the faces of one block in a chunk's uploaded mesh and sends only those quads to the GPU
+        // returns false without changing anything if the mesh can't be patched and needs a full remesh
+        // must be called on the thread that owns the GPU
+        static bool PatchBlock(World& world, Chunk& chunk, int h, int v, int d);
 
         Status GetStatus() const;
 
@@ -32,14 +124,44 @@ namespace Voxels
         World&              Map;
         ChunkId             MapChunk;
         CubeGeometryBuilder Builder;
-        Mesh                ChunkMesh = { 0 };
+        MeshBuffer          ChunkMesh;
         Status              BuildStatus = Status::Unbuilt;
+        MeshingMode         Mode = MeshingMode::Faces;
+        int                 Lod = 0;
+        BoundingBox         MeshBounds = { 0 };
+        int                 SpareFaces = MinSpareFaces;
+
+        std::shared_ptr<ChunkFaceIndex> FaceIndex;
 
         mutable std::mutex  StatusLock;
 
+        // padded copy of the chunk being meshed, so neighbor lookups never touch the world
+        ChunkNeighborhood   Neighborhood;
+
         void SetStatus(Status status);
 
-        int GetChunkFaceCount();
+        BlockType GetVoxel(int h, int v, int d) const { return Neighborhood.GetVoxel(h, v, d); }
+
+        void ComputeMeshBounds();
+
+        void BuildFaceMesh();
+        void BuildGreedyMesh();
+        void BuildLodMesh();
+
+        // merges the visible faces of a size by size by height grid of cells into quads, cells are scale blocks on a side
+        // getFace returns the block drawn on one face of a cell, or InvalidBlock if that face is not drawn
+        template <class GetFace>
+        void MergeFaces(int size, int height, int scale, GetFace getFace, MeshFaceRanges& ranges);
+
+        // every builder writes all the quads of one face direction before the next, in face order
+        void BeginFaceRange(MeshFaceRanges& ranges, int face) { ranges.First[face] = uint32_t(Builder.GetQuadCount()); }
+        void EndFaceRange(MeshFaceRanges& ranges, int face) { ranges.Count[face] = uint32_t(Builder.GetQuadCount()) - ranges.First[face]; }
+
+        // empty quads added to face meshes for patches to use, chunks start with a few and get more each
+        // time a patch runs out, only the spares that have been used are drawn
+        static constexpr int MinSpareFaces = 16;
+        static constexpr int MaxSpareFaces = 1024;
+        static int GetSpareFaceCount(int wanted) { return std::clamp(wanted, MinSpareFaces, MaxSpareFaces); }
     };
 
     class ChunkMeshTaskPool
@@ -48,10 +170,40 @@ namespace Voxels
         ChunkMeshTaskPool(World& world);
         ~ChunkMeshTaskPool();
 
+        // stops the worker and drops every queued and finished mesh
         void Abort();
 
-        void PushChunk(ChunkId chunk);
-        bool PopChunk(ChunkId* chunk);
+        // a finished request, the mesh only belongs to the thread that popped it so nothing on the chunk is shared
+        struct CompletedMesh
+        {
+            ChunkId Id;
+
+            // the epoch the chunk had when it was queued, a different epoch means the chunk was reused
+            uint32_t Epoch = 0;
+
+            // false if the chunk was reused or unloaded while it was meshing, the request still comes back so it is not lost
+            bool Built = false;
+
+            MeshBuffer Mesh;
+            std::shared_ptr<ChunkFaceIndex> Faces;
+
+            // the block version the mesh was built from
+            uint32_t Version = 0;
+            int Lod = 0;
+            BoundingBox Bounds = { 0 };
+        };
+
+        // high priority chunks skip ahead of everything else, use it for remeshing chunks that are on screen
+        // every request comes back from PopChunk once, built or not
+        void PushChunk(ChunkId chunk, uint32_t epoch, bool highPriority = false, int lod = 0);
+        bool PopChunk(CompletedMesh* mesh);
+
+        // applies to meshes started after the change, chunks that are already meshed keep their mesh until remeshed
+        void SetMeshingMode(MeshingMode mode) { Mode = mode; }
+        MeshingMode GetMeshingMode() const { return Mode; }
+
+        void SetVertexFormat(CubeGeometryBuilder::VertexFormat format) { Format = format; }
+        CubeGeometryBuilder::VertexFormat GetVertexFormat() const { return Format; }
     
     private:
         void StartQueue();
@@ -59,7 +211,14 @@ namespace Voxels
 
         bool RunOneTask();
 
-        bool PopPendingChunk(ChunkId* chunk);
+        struct MeshRequest
+        {
+            ChunkId Id;
+            uint32_t Epoch = 0;
+            int Lod = 0;
+        };
+
+        bool PopPendingChunk(MeshRequest* request);
         bool PendingChunksEmpty();
 
         void StopQueue();
@@ -73,7 +232,11 @@ namespace Voxels
 
         bool RunQueue = false;
 
-        std::list<ChunkId> PendingChunks;
-        std::deque<ChunkId> CompletedChunks;
+        std::atomic<MeshingMode> Mode = MeshingMode::Faces;
+        std::atomic<CubeGeometryBuilder::VertexFormat> Format = CubeGeometryBuilder::VertexFormat::Float;
+
+        std::list<MeshRequest> PendingChunks;
+        std::deque<MeshRequest> PriorityChunks;
+        std::deque<CompletedMesh> CompletedChunks;
     };
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "voxel_lib.h"
+
+namespace Voxels
+{
+    // a copy of a chunk with a one block border taken from the 6 chunks around it
+    // sky reads as EmptyBlock and chunks that are not loaded or below the world read as InvalidBlock
+    // so the mesher can look at any neighbor of a chunk block without locks or bounds checks
+    class ChunkNeighborhood
+    {
+    public:
+        static constexpr int Width = Chunk::ChunkSize + 2;
+        static constexpr int Height = Chunk::ChunkHeight + 2;
+        static constexpr int BlockCount = Width * Width * Height;
+
+        // returns false if the center chunk does not exist
+        bool Capture(World& world, ChunkId id);
+
+        // coordinates are relative to the center chunk and can be one block outside of it
+        static int GetIndex(int h, int v, int d) { return ((d + 1) * Width * Width) + ((v + 1) * Width) + (h + 1); }
+
+        BlockType GetVoxel(int h, int v, int d) const { return Blocks[GetIndex(h, v, d)]; }
+        bool BlockIsSolid(int h, int v, int d) const { return BlockRegistry::IsSolid(Blocks[GetIndex(h, v, d)]); }
+
+        // solid masks for the center columns and the border columns next to them, h and v can be -1 to ChunkSize
+        Chunk::ColumnMask GetSolidColumn(int h, int v) const { return SolidColumns[((v + 1) * Width) + (h + 1)]; }
+
+        // the blocks of a center column that have each face open to a non solid block, indexed by face
+        void GetColumnFaces(int h, int v, Chunk::ColumnMask faces[6]) const;
+
+        // the center chunk blocks this was captured from
+        const ChunkSnapshot& GetCenter() const { return Center; }
+        uint32_t GetVersion() const { return Center.Version; }
+
+    private:
+        BlockType Blocks[BlockCount];
+        Chunk::ColumnMask SolidColumns[Width * Width];
+        ChunkSnapshot Center;
+    };
+}
@@ -23,33 +23,153 @@
 #include "raylib.h"
 
 #include "voxel_lib.h"
+#include "mesh_buffer.h"
 
 class CubeGeometryBuilder
 {
 public:
-    // setup the builder with the mesh it is going to fill out
-    CubeGeometryBuilder(Mesh& mesh);
+    enum class VertexFormat
+    {
+        // separate float arrays for positions, normals and both texcoords, 40 bytes a vertex
+        Float,
+        // two words a vertex in the colors array, see PackedVertexSize
+        Packed,
+    };
 
-    // we need to know how many triangles are going to be in the mesh before we start
+    // packed vertices are 8 bytes
+    // bytes 0-3 are the chunk local position and the face index, read by the shader as vertexPosition
+    // bytes 4-7 are the atlas tile column and row and the position on the face in blocks, read as vertexColor
+    static constexpr int PackedVertexSize = Voxels::MeshBuffer::PackedVertexSize;
+
+    static_assert(Voxels::Chunk::ChunkSize <= 255 && Voxels::Chunk::ChunkHeight <= 255, "packed vertices store positions in bytes");
+
+    // setup the builder with the buffer it is going to fill out
+    CubeGeometryBuilder(Voxels::MeshBuffer& output, VertexFormat format = VertexFormat::Float);
+
+    // quads are 4 vertices drawn with a shared index buffer, this is as many as 16 bit indices can reach
+    // bigger meshes fall back to 6 vertices a quad and no indices
+    static constexpr int MaxIndexedQuads = 65536 / 4;
+
+    // we need to know how many faces are going to be in the mesh before we start
     // this way we can allocate the correct buffer sizes for the mesh
-    void Allocate(int triangles);
+    // allowIndices false always uses 6 vertices a quad, to match a mesh that has no indices
+    void Allocate(int faces, bool allowIndices = true);
 
-    void SetNormal(Vector3& value);
-    void SetNormal(float x, float y, float z);
-    void SetSetUV(Vector2& value);
-    void SetSetUV(float x, float y);
+    // or build a mesh without knowing its size, Begin points the mesh at scratch buffers owned by the calling thread
+    // they grow as needed and are kept for the next mesh, Finish copies the faces into the output buffer at their
+    // exact size and adds spare zeroed faces at the end
+    void Begin();
+    void Finish(int spareFaces = 0);
 
-    void PushVertex(Vector3& vertex, float xOffset = 0, float yOffset = 0, float zOffset = 0);
+    // the order AddCube writes faces in
+    static constexpr int FaceOrder[6] = { Voxels::NorthFace, Voxels::SouthFace, Voxels::WestFace, Voxels::EastFace, Voxels::UpFace, Voxels::DownFace };
 
     void AddCube(Vector3&& position, bool faces[6], Voxels::BlockType block);
+    void AddFace(Vector3& position, int face, Voxels::BlockType block);
+
+    // one face stretched over size blocks, the size along the face normal is how far the block it covers is from its
+    // position, 1 for single blocks and merged faces
+    void AddQuad(Vector3& position, int face, Voxels::BlockType block, const Vector3& size);
+
+    // quads written so far
+    size_t GetQuadCount() const { return VertexIndex / (Indexed ? 4 : 6); }
+
+    // these move to or erase the quad at a slot in the output buffer
+    void SetFaceSlot(size_t slot);
+    void ClearFace(size_t slot);
+
+    // uploaded meshes have no CPU arrays, but packed ones only ever get the one vertex buffer
+    static bool IsPacked(const Mesh& mesh)
+    {
+        if (mesh.vboId != nullptr)
+            return mesh.vboId[0] != 0 && mesh.vboId[2] == 0;
+        return mesh.vertices == nullptr && mesh.colors != nullptr;
+    }
+    static int GetVertsPerFace(const Mesh& mesh) { return mesh.indices != nullptr ? 4 : 6; }
+
+    // the index list every indexed mesh points at, it must never be freed by the mesh
+    static const unsigned short* GetQuadIndices();
+
+    // sends a built mesh to the GPU and gives its buffer back to the pool, the mesh that comes back has no CPU arrays
+    // packed meshes get their own vertex array since raylib only knows the float layout
+    // an empty buffer uploads nothing and comes back as a mesh with no vertex array, which Unload and DrawFaces skip
+    // the GPU buffers are not owned by anything, whoever uploads a mesh has to Unload it
+    static Mesh Upload(Voxels::MeshBuffer&& buffer);
+
+    // sends the first count quads of faces over a range of slots in an uploaded mesh
+    static void UpdateFaces(Mesh& mesh, const Mesh& faces, size_t firstSlot, size_t count);
+
+    // the face directions whose quads inside a box can point at a point, as a bit for each face
+    // quads facing away from the camera can't be seen, so only these need to be drawn
+    static uint8_t GetFacesToward(const Vector3& point, const Vector3& boxMin, const Vector3& boxMax);
+
+    // draws a mesh like DrawMesh, but only the face ranges with a bit set in faceMask, the any face range is always drawn
+    // returns the number of triangles drawn
+    static int DrawFaces(const Mesh& mesh, const Voxels::MeshFaceRanges& ranges, uint8_t faceMask, const Material& material, const Matrix& transform);
+
+    // use this instead of UnloadMesh, raylib would try to free the shared indices
+    static void Unload(Mesh& mesh);
+
+    // drops the GPU index buffer, all meshes must be unloaded first
+    static void UnloadSharedBuffers();
 
 protected:
-    Mesh& MeshRef;
+    Voxels::MeshBuffer& Output;
+
+    // the arrays being written, either the output buffer or the thread's scratch while growing
+    Mesh MeshRef = { 0 };
+    VertexFormat Format = VertexFormat::Float;
+
+    bool Indexed = false;
+    bool Growing = false;
+    size_t VertexIndex = 0;
+
+    // the corners of each face in the order the shared indices expect
+    struct QuadCorner
+    {
+        float X, Y, Z;
+        bool MaxU, MaxV;
+    };
+
+    static constexpr QuadCorner FaceCorners[6][4] =
+    {
+        // south
+        { { 0, 0, 1, false, true }, { 1, 0, 1, true, true }, { 1, 1, 1, true, false }, { 0, 1, 1, false, false } },
+        // north
+        { { 0, 0, 0, false, true }, { 0, 1, 0, false, false }, { 1, 1, 0, true, false }, { 1, 0, 0, true, true } },
+        // west
+        { { 1, 0, 1, true, true }, { 1, 0, 0, false, true }, { 1, 1, 0, false, false }, { 1, 1, 1, true, false } },
+        // east
+        { { 0, 0, 1, true, true }, { 0, 1, 1, true, false }, { 0, 1, 0, false, false }, { 0, 0, 0, false, true } },
+        // up
+        { { 0, 1, 0, false, false }, { 0, 1, 1, false, true }, { 1, 1, 1, true, true }, { 1, 1, 0, true, false } },
+        // down
+        { { 0, 0, 0, false, false }, { 1, 0, 0, true, false }, { 1, 0, 1, true, true }, { 0, 0, 1, false, true } },
+    };
+
+    static constexpr float FaceNormals[6][3] =
+    {
+        { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 },
+    };
+
+    // the quad size axes the texture repeats along for each face, as u then v, 0 is x, 1 is y and 2 is z
+    static constexpr int FaceSpanAxes[6][2] =
+    {
+        { 0, 1 }, { 0, 1 }, { 2, 1 }, { 2, 1 }, { 0, 2 }, { 0, 2 },
+    };
+
+    static inline unsigned int SharedIndexBuffer = 0;
+
+    void Reserve(size_t vertices);
+
+    static Mesh DropVertexArrays(Mesh mesh);
 
-    size_t TriangleIndex = 0;
-    size_t VertIndex = 0;
+    // vertex layout policies, each knows which arrays its format has and writes a whole vertex with no checks
+    // texcoords hold the corner of the atlas tile and texcoords2 the position on the face in blocks
+    struct FloatLayout;
+    struct PackedLayout;
 
-    Vector3 Normal;
-    Color VertColor;
-    Vector2 UV;
+    // writes one quad as a fixed run of Count corners, 4 for indexed meshes and 6 for two whole triangles
+    template <class Layout, int Count>
+    void EmitQuad(const Vector3& position, int face, Voxels::BlockType block, const Vector3& size);
 };
@@ -0,0 +1,89 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "raylib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Voxels
+{
+    // the quads of a mesh grouped by the way they face, indexed by face, so directions that point away from the
+    // camera can be skipped when drawing, the last range holds quads that may face any way, like spares for patches
+    struct MeshFaceRanges
+    {
+        static constexpr int AnyFace = 6;
+        static constexpr int RangeCount = 7;
+
+        uint32_t First[RangeCount] = { 0 };
+        uint32_t Count[RangeCount] = { 0 };
+    };
+
+    // the CPU side of a mesh, from the mesher that fills it to the upload that sends it to the GPU
+    // the vertex arrays live in one block taken from a pool of size classes and go back to it when the buffer is
+    // destroyed, so meshes are never copied and can't be freed twice
+    // buffers with no vertices take no block and stay empty
+    class MeshBuffer
+    {
+    public:
+        // packed vertices are 8 bytes in the colors array, float vertices are positions, normals and both texcoords
+        static constexpr int PackedVertexSize = 8;
+        static constexpr int FloatVertexSize = sizeof(float) * (3 + 3 + 2 + 2);
+
+        MeshBuffer() = default;
+
+        // takes a zeroed block big enough for the vertices and points the mesh arrays into it, 0 vertices leaves it empty
+        MeshBuffer(int vertexCount, bool packed);
+
+        ~MeshBuffer() { Release(); }
+
+        MeshBuffer(const MeshBuffer&) = delete;
+        MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+        MeshBuffer(MeshBuffer&& other) noexcept;
+        MeshBuffer& operator=(MeshBuffer&& other) noexcept;
+
+        bool IsEmpty() const { return Block == nullptr; }
+        bool IsPacked() const { return Packed; }
+
+        // the raylib view of the vertex data, the arrays belong to the buffer and must not be freed through it
+        Mesh& GetMesh() { return View; }
+        const Mesh& GetMesh() const { return View; }
+
+        // set by the mesher after the quads are written, where each face direction is in the buffer
+        MeshFaceRanges& GetFaceRanges() { return FaceRanges; }
+        const MeshFaceRanges& GetFaceRanges() const { return FaceRanges; }
+
+        // gives the block back to the pool and empties the buffer
+        void Release();
+
+        // bytes held by the pool that are not in any buffer
+        static size_t GetPooledBytes();
+
+    private:
+        void* Block = nullptr;
+        int SizeClass = -1;
+        bool Packed = false;
+        Mesh View = { 0 };
+        MeshFaceRanges FaceRanges;
+    };
+}
@@ -9,4 +9,7 @@ namespace Tasks
 
     using TaskFunction = std::function<void()>;
     bool AddTask(TaskFunction task);
+
+    // blocks until every task that was added has run
+    void WaitForTasks();
 }
\ No newline at end of file
@@ -23,40 +23,29 @@
 #include <stdint.h>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <vector>
 #include <functional>
+#include <memory>
+#include <type_traits>
 
 #include "raylib.h"
 
+#include "chunk_layout.h"
+#include "block_storage.h"
+#include "block_registry.h"
+#include "world_edit.h"
+#include "mesh_buffer.h"
+
 namespace Voxels
 {
-    using BlockType = uint8_t;
-    static constexpr BlockType InvalidBlock = BlockType(-1);
-
-    // indexes for the 6 faces of a cube
-    static constexpr int SouthFace = 0;
-    static constexpr int NorthFace = 1;
-    static constexpr int WestFace = 2;
-    static constexpr int EastFace = 3;
-    static constexpr int UpFace = 4;
-    static constexpr int DownFace = 5;
-
-    struct BlockInfo
-    {
-        Rectangle FaceUVs[6] = { 0 };
-        BlockType BlockID = InvalidBlock;
-        bool Solid = true;
-    };
-
-    extern std::unordered_map<BlockType, BlockInfo> BlockInfos;
-
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, bool solid = true);
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, Rectangle& blockTop, bool solid = true);
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, Rectangle& blockTop, Rectangle& blockBottom, bool solid = true);
-
+    // chunks are addressed in 3d, h and v across the ground and d for the vertical layer
+    // the three coordinates are packed into 64 bits so the id can be used as a key
     struct ChunkCoordinate
     {
-        int32_t h;
-        int32_t v;
+        int64_t h : 24;
+        int64_t v : 24;
+        int64_t d : 16;
     };
 
     union ChunkId
@@ -66,10 +55,16 @@ namespace Voxels
 
         ChunkId() {}
 
-        ChunkId(int32_t h, int32_t v)
+        ChunkId(int32_t h, int32_t v, int32_t d = 0)
         {
             Coordinate.h = h;
             Coordinate.v = v;
+            Coordinate.d = d;
+        }
+
+        ChunkId Offset(int32_t h, int32_t v, int32_t d) const
+        {
+            return ChunkId(int32_t(Coordinate.h) + h, int32_t(Coordinate.v) + v, int32_t(Coordinate.d) + d);
         }
 
         ChunkId(uint64_t id)
@@ -83,6 +78,43 @@ namespace Voxels
         }
     };
 
+    class ChunkFaceIndex;
+    struct ChunkSnapshot;
+
+    // bit helpers for column masks
+    inline int CountBits(uint64_t bits)
+    {
+#if defined(_MSC_VER)
+        return int(__popcnt64(bits));
+#else
+        return __builtin_popcountll(bits);
+#endif
+    }
+
+    // bits must not be 0
+    inline int FindLowestBit(uint64_t bits)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward64(&index, bits);
+        return int(index);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    // bits must not be 0
+    inline int FindHighestBit(uint64_t bits)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse64(&index, bits);
+        return int(index);
+#else
+        return 63 - __builtin_clzll(bits);
+#endif
+    }
+
     enum class ChunkStatus
     {
         Empty,
@@ -105,52 +137,428 @@ namespace Voxels
     class Chunk
     {
     public:
-        static constexpr int ChunkSize = 16;
-        static constexpr int ChunkHeight = 32;
+        static constexpr int ChunkSize = VOXEL_CHUNK_SIZE;
+        static constexpr int ChunkHeight = VOXEL_CHUNK_HEIGHT;
+        static constexpr int BlockCount = ChunkSize * ChunkSize * ChunkHeight;
+
+        // chunks are stored as vertical stacks of sections
+        static constexpr int SectionHeight = 8;
+        static constexpr int SectionCount = ChunkHeight / SectionHeight;
+        static constexpr int SectionBlockCount = ChunkSize * ChunkSize * SectionHeight;
+
+        static_assert(ChunkHeight % SectionHeight == 0, "chunk height must be a multiple of the section height");
+        static_assert(ChunkHeight <= 64, "column masks store one bit per block");
+
+        // one bit per block in a column, bit d is set if the block at depth d is solid
+        using ColumnMask = std::conditional_t<ChunkHeight <= 32, uint32_t, uint64_t>;
+        static constexpr ColumnMask FullColumn = ColumnMask(~uint64_t(0) >> (64 - ChunkHeight));
+
+        static constexpr int GetColumnIndex(int h, int v) { return (v * ChunkSize) + h; }
+
+        // order of the blocks inside each section
+        using SectionLayout = VOXEL_CHUNK_LAYOUT<ChunkSize, SectionHeight>;
+
+        // index into a flat buffer of all the blocks in the chunk
+        // sections follow each other and the layout policy orders the blocks inside each one
+        static constexpr int GetIndex(int h, int v, int d)
+        {
+            return ((d / SectionHeight) * SectionBlockCount) + SectionLayout::GetIndex(h, v, d % SectionHeight);
+        }
+
+        Chunk();
 
         ChunkId Id;
 
         BlockType GetVoxel(int h, int v, int d);
         void SetVoxel(int h, int v, int d, BlockType block);
 
+        // write a run of blocks along h, the run is clipped to the chunk
+        // SetRow skips InvalidBlock entries so callers can leave holes
+        void SetRow(int h, int v, int d, int count, const BlockType* blocks);
+        void FillRow(int h, int v, int d, int count, BlockType block);
+
+        // bulk access to all the blocks in the chunk, ordered by GetIndex
+        void GetBlocks(BlockType* blocks) const;
+        void SetBlocks(const BlockType* blocks);
+
+        // an immutable copy of the blocks that only costs a copy of each section pointer and the column masks
+        // writers copy a section before changing it if a snapshot still holds it
+        ChunkSnapshot TakeSnapshot() const;
+
+        // goes up every time a block changes
+        uint32_t GetVersion() const;
+
+        size_t GetMemoryUsage() const;
+
+        // returns true if the section is all one block type, and what that type is
+        bool SectionIsUniform(int section, BlockType* block = nullptr) const;
+
+        // true if every block in the chunk is EmptyBlock
+        bool IsEmpty() const;
+
+        // resets every block to EmptyBlock
+        void Clear();
+
+        // moves the blocks of another chunk into this one and clears the other
+        void TakeBlocks(Chunk& other);
+
         int Chunk::GetTopBlockDepth(int h, int v);
 
+        // highest solid or opaque block in each column, -1 if the column has none
+        // these and the column masks are kept up to date by SetVoxel and rebuilt by the bulk block functions
+        // they are read without the lock, so a writer on another thread may be part way through a row
+        int GetTopSolidDepth(int h, int v) const { return TopSolid[GetColumnIndex(h, v)].load(std::memory_order_relaxed); }
+        int GetTopOpaqueDepth(int h, int v) const { return TopOpaque[GetColumnIndex(h, v)].load(std::memory_order_relaxed); }
+        ColumnMask GetSolidColumn(int h, int v) const { return SolidColumns[GetColumnIndex(h, v)].load(std::memory_order_relaxed); }
+
+        void RebuildColumns();
+
         bool BlockIsSolid(int h, int v, int d);
 
-        Mesh ChunkMesh;
+        // the uploaded mesh that is drawn, it has no CPU arrays
+        // these are only used on the main thread, new meshes come from the mesher's queue and never wait in the chunk
+        Mesh ChunkMesh = { 0 };
+        MeshFaceRanges ChunkMeshFaces;
+
+        // block version the mesh was built from
+        uint32_t MeshVersion = 0;
+
+        // level of detail of the mesh, see ChunkMesher::GetLodScale
+        int MeshLod = 0;
+
+        // chunk local box around the mesh, only as tall as the solid blocks in the chunk, for culling
+        BoundingBox MeshBounds = { 0 };
+
+        // which quad of the mesh belongs to each block face, so small edits can patch the mesh in place
+        std::shared_ptr<ChunkFaceIndex> MeshFaces;
 
+        // spare quads the next face mesh is built with, 0 for the mesher's minimum
+        // raised on the main thread when a patch runs out of them, never while a mesh is building
+        int MeshSpareFaces = 0;
+
+        // raised by edits and by neighbors that change, drawn chunks that are dirty get remeshed
+        void MarkDirty();
+        bool IsDirty() const;
+        void ClearDirty();
+
+        // counts every MarkDirty, so a caller that dealt with the marks it knows about can clear the flag without
+        // losing one from another thread, the flag is only cleared and true returned if the count still matches
+        uint32_t GetDirtyCount() const;
+        bool ClearDirty(uint32_t dirtyCount);
+
+        // status, visibility and epoch are packed into one atomic word so they can be read and
+        // changed without locks, use TryTransition when more than one thread may move the status
         ChunkStatus GetStatus() const;
         void SetStatus(ChunkStatus status);
+        bool TryTransition(ChunkStatus from, ChunkStatus to);
 
         ChunkVisibilityRequirement GetVisRequirement() const;
         void SetVisRequirement(ChunkVisibilityRequirement status);
 
+        // the epoch changes every time the chunk object is reused for different data
+        // workers compare it before and after a job to find out if their work is stale
+        uint32_t GetEpoch() const;
+        void AdvanceEpoch();
+
         float Alpha = 0;
 
+        // pinned chunks are never evicted, use World::PinChunk and ChunkHandle instead of calling these directly
+        void Pin();
+        void Unpin();
+        bool IsPinned() const;
+
+        // set when a world edit writes to the chunk, like a player edit or a tree growing in from a neighbor
+        // the generator can't make these blocks again, so eviction keeps modified chunks
+        void MarkModified() { Modified.store(true, std::memory_order_relaxed); }
+        bool IsModified() const { return Modified.load(std::memory_order_relaxed); }
+        void ClearModified() { Modified.store(false, std::memory_order_relaxed); }
+
+        // the world tick the chunk was last used on, eviction drops the least recently used chunks first
+        void Touch(uint32_t tick) { LastTouched.store(tick, std::memory_order_relaxed); }
+        uint32_t GetLastTouched() const { return LastTouched.load(std::memory_order_relaxed); }
+
     private:
-        BlockType Blocks[ChunkSize * ChunkSize * ChunkHeight] = { 0 };
+        // owned by the chunk and shared with snapshots, only writers holding SectionLock change them
+        std::shared_ptr<ChunkSection> Sections[SectionCount];
 
-        mutable std::mutex StatusLock;
-        ChunkStatus Status = ChunkStatus::Empty;
-        ChunkVisibilityRequirement VisStatus = ChunkVisibilityRequirement::Unknown;
+        // the same sections for readers that don't take the lock
+        // a published section is never changed, writers change a copy, publish it and retire the old one
+        std::atomic<const ChunkSection*> PublishedSections[SectionCount];
+
+        // held by writers and by snapshots copying the section pointers, see SectionLockGuard
+        mutable std::atomic_flag SectionLock = ATOMIC_FLAG_INIT;
+        std::atomic<uint32_t> Version = 0;
+
+        std::shared_ptr<ChunkSection> CopySection(int section) const;
+        void PublishSection(int section, std::shared_ptr<ChunkSection> sectionData);
+
+        std::atomic<uint32_t> Pins = 0;
+        // bit 0 is the dirty flag, the rest counts the marks
+        std::atomic<uint32_t> Dirty = 0;
+        std::atomic<bool> Modified = false;
+        std::atomic<uint32_t> LastTouched = 0;
+
+        std::atomic<int16_t> TopSolid[ChunkSize * ChunkSize];
+        std::atomic<int16_t> TopOpaque[ChunkSize * ChunkSize];
+        std::atomic<ColumnMask> SolidColumns[ChunkSize * ChunkSize];
+
+        void ClearColumns();
+        void UpdateColumn(int h, int v, int d, BlockType block);
+        void UpdateColumn(int h, int v, int d, bool solid, bool opaque);
+        int FindTopBlock(int h, int v, int startD, bool opaque);
+
+        // bits 0-7 status, 8-15 visibility, 16-31 epoch
+        static constexpr uint32_t StatusMask = 0x000000FF;
+        static constexpr uint32_t VisibilityShift = 8;
+        static constexpr uint32_t VisibilityMask = 0x0000FF00;
+        static constexpr uint32_t EpochShift = 16;
+        static constexpr uint32_t EpochMask = 0xFFFF0000;
+
+        std::atomic<uint32_t> State = uint32_t(ChunkStatus::Empty) | (uint32_t(ChunkVisibilityRequirement::Unknown) << VisibilityShift);
+
+        void UpdateState(uint32_t mask, uint32_t value);
+    };
+
+    // blocks of a chunk at one version, safe to read from any thread without locks
+    struct ChunkSnapshot
+    {
+        uint32_t Version = 0;
+        std::shared_ptr<const ChunkSection> Sections[Chunk::SectionCount];
+        Chunk::ColumnMask SolidColumns[Chunk::ChunkSize * Chunk::ChunkSize];
+
+        bool IsValid() const { return Sections[0] != nullptr; }
+
+        BlockType GetVoxel(int h, int v, int d) const;
+        void GetBlocks(BlockType* blocks) const;
+        bool SectionIsUniform(int section, BlockType* block = nullptr) const;
+    };
+
+    // keeps a chunk pinned for as long as the handle is alive
+    // worker threads use these so a chunk can not be evicted and reused while they read it
+    class ChunkHandle
+    {
+    public:
+        ChunkHandle() = default;
+        ChunkHandle(const ChunkHandle&) = delete;
+        ChunkHandle(ChunkHandle&& other) noexcept;
+        ~ChunkHandle();
+
+        ChunkHandle& operator=(const ChunkHandle&) = delete;
+        ChunkHandle& operator=(ChunkHandle&& other) noexcept;
+
+        Chunk* Get() const { return PinnedChunk; }
+        Chunk* operator->() const { return PinnedChunk; }
+        Chunk& operator*() const { return *PinnedChunk; }
+        explicit operator bool() const { return PinnedChunk != nullptr; }
+
+        void Reset();
+
+    private:
+        friend class World;
+        explicit ChunkHandle(Chunk* chunk) : PinnedChunk(chunk) {}
+
+        Chunk* PinnedChunk = nullptr;
+    };
+
+    // hands out chunks from large pages and reuses released chunks
+    // chunk memory is only returned to the system when the pool is destroyed, so a stale
+    // chunk pointer always points at a chunk, compare epochs to find out if it was reused
+    // not thread safe, the world only calls it while holding its chunk lock
+    class ChunkPool
+    {
+    public:
+        static constexpr size_t PageSize = 256;
+
+        // the chunk is cleared, has a new epoch and an empty status
+        Chunk* Acquire();
+
+        // frees the chunk's blocks and face index right away, so evicted memory really is freed
+        // the chunk's GPU mesh must already be unloaded, the pool can't do it from a worker thread
+        void Release(Chunk* chunk);
+
+        // makes every chunk available again in one step, each chunk only gets a new epoch so stale pointers can tell
+        // the rest of the clean up and freeing their blocks waits until they are handed out again
+        // no chunk may be pinned or still have its GPU mesh
+        void Reset();
+
+        size_t GetPageCount() const { return Pages.size(); }
+        size_t GetUsedCount() const { return UsedCount; }
+
+    private:
+        std::vector<std::unique_ptr<Chunk[]>> Pages;
+        std::vector<Chunk*> FreeChunks;
+
+        // chunks past this point in the pages have never been handed out
+        size_t NextPage = 0;
+        size_t NextInPage = 0;
+
+        size_t UsedCount = 0;
+    };
+
+    // a fixed block of chunks, chunks inside a region are found by direct indexing
+    struct ChunkRegion
+    {
+        static constexpr int RegionShift = 5;
+        static constexpr int RegionSize = 1 << RegionShift;
+        static constexpr int RegionHeightShift = 2;
+        static constexpr int RegionHeight = 1 << RegionHeightShift;
+
+        int32_t H = 0;
+        int32_t V = 0;
+        int32_t D = 0;
+
+        std::atomic<Chunk*> Chunks[RegionSize * RegionSize * RegionHeight] = {};
+
+        static int GetIndex(int32_t h, int32_t v, int32_t d)
+        {
+            return ((d & (RegionHeight - 1)) * RegionSize * RegionSize) + ((v & (RegionSize - 1)) * RegionSize) + (h & (RegionSize - 1));
+        }
     };
 
     class World
     {
     public:
-        Chunk& AddChunk(int32_t h, int32_t v);
+        World();
+        ~World();
+
+        Chunk& AddChunk(int32_t h, int32_t v, int32_t d);
+        Chunk& AddChunk(ChunkId id);
+
+        // returns the chunk to the pool, any mesh must already be unloaded
+        void RemoveChunk(ChunkId id);
 
-        Chunk* GetChunk(int32_t h, int32_t v);
+        // drops every chunk and region at once so a world can be loaded again
+        // mesh and build requests for the old chunks are dropped by the epoch change
+        // no chunk may be pinned and every mesh must already be unloaded, so the builder and mesher have to be stopped
+        // call from the same thread that uses raw chunk pointers
+        void Reset();
+
+        size_t GetChunkCount() const { return Pool.GetUsedCount(); }
+
+        // returns an empty handle if the chunk has no storage
+        ChunkHandle PinChunk(ChunkId id);
+
+        // bytes of chunk memory the world tries to stay under, 0 is unlimited
+        void SetMemoryBudget(size_t bytes) { MemoryBudget = bytes; }
+        size_t GetMemoryBudget() const { return MemoryBudget; }
+
+        // removes the least recently used chunks until the world is under budget, farthest from the center first
+        // among chunks last used at about the same time
+        // only generated chunks that are not pinned and pass the filter are removed, regions left empty are freed
+        // modified chunks are never removed, so edits can keep the world over budget
+        // call from the same thread that uses raw chunk pointers, returns the number of chunks removed
+        size_t EvictChunks(ChunkId center, std::function<bool(const Chunk&)> canEvict = nullptr);
+
+        // the clock for the least recently used ranking, advance it once a frame
+        // pinning or adding a chunk counts as using it, anything else can call TouchChunk
+        void AdvanceTick() { Tick.fetch_add(1, std::memory_order_relaxed); }
+        uint32_t GetTick() const { return Tick.load(std::memory_order_relaxed); }
+        void TouchChunk(Chunk& chunk) const { chunk.Touch(GetTick()); }
+
+        // lookups never lock, chunk memory belongs to the pool and stays valid for the life of the world
+        Chunk* GetChunk(int32_t h, int32_t v, int32_t d);
         Chunk* GetChunk(ChunkId id);
 
+        // range of chunk layers that can hold blocks
+        // everything above the top layer is open sky and everything below the bottom is solid
+        void SetChunkLayers(int32_t minD, int32_t maxD);
+        int32_t GetMinChunkLayer() const { return MinChunkLayer; }
+        int32_t GetMaxChunkLayer() const { return MaxChunkLayer; }
+
+        // chunks that generate without any blocks are recorded as sky and never get storage
+        void SetSkyChunk(ChunkId id);
+        bool IsSkyChunk(ChunkId id) const;
+
+        // block to use for a chunk that has no storage, EmptyBlock for sky or InvalidBlock if it is unknown
+        BlockType GetMissingChunkBlock(ChunkId id) const;
+
         bool SurroundingChunksGenerated(ChunkId id) const;
 
+        // flags the 6 neighbors of a chunk so their border faces are rebuilt
+        void MarkNeighborsDirty(ChunkId id);
+
+        // block coordinates may be outside the chunk, they are moved into the chunk that holds them
         BlockType GetVoxel(ChunkId chunk, int h, int v, int d);
         bool BlockIsSolid(ChunkId chunk, int h, int v, int d);
 
+        // bulk edits in world block coordinates, boxes are inclusive
+        // each edit visits every chunk it touches once and writes whole rows at a time
+        // changed chunks and the neighbors that share a changed border are added to dirtyChunks
+        // chunks that are not generated yet are skipped, open sky gets new chunks
+        void SetVoxel(const BlockPosition& position, BlockType block, DirtyChunkSet* dirtyChunks = nullptr);
+        void FillBox(const BlockPosition& min, const BlockPosition& max, BlockType block, DirtyChunkSet* dirtyChunks = nullptr);
+        void FillSphere(const BlockPosition& center, int radius, BlockType block, DirtyChunkSet* dirtyChunks = nullptr);
+        void DrawLine(const BlockPosition& start, const BlockPosition& end, BlockType block, DirtyChunkSet* dirtyChunks = nullptr);
+        void PasteSchematic(const Schematic& schematic, const BlockPosition& origin, DirtyChunkSet* dirtyChunks = nullptr);
+
+        static ChunkId GetChunkIdForBlock(const BlockPosition& position);
+        static BlockPosition GetChunkOrigin(ChunkId id);
+
+        // depth of the highest solid (or opaque) block at a world block position, using the chunk height maps
+        // returns false if there is no ground there or the chunks above it are not generated yet
+        bool GetGroundDepth(int64_t worldH, int64_t worldV, int64_t& depth, bool opaque = false);
+
     private:
-        mutable std::mutex ChunkLock;
-        std::unordered_map<uint64_t, Chunk> Chunks;
+        // open addressed table of regions, readers probe it without locking
+        // removed regions leave a marker behind so probes keep going, the table is replaced by a fresh copy
+        // when it gets too full of regions and markers
+        struct RegionTable
+        {
+            RegionTable(size_t capacity);
+
+            size_t Capacity = 0;
+            std::unique_ptr<std::atomic<ChunkRegion*>[]> Slots;
+        };
+
+        // only taken by writers adding chunks or regions
+        std::mutex ChunkLock;
+
+        std::atomic<RegionTable*> Regions = nullptr;
+        size_t RegionCount = 0;
+        size_t RemovedRegionCount = 0;
+
+        std::unique_ptr<RegionTable> CurrentRegionTable;
+        std::vector<std::unique_ptr<ChunkRegion>> RegionStorage;
+
+        // threads in the middle of a lookup may still be holding a replaced table or a removed region
+        // those are kept here until a moment when no lookup is running, see RegionReadGuard
+        mutable std::atomic<int> RegionReaders = 0;
+        std::vector<std::unique_ptr<RegionTable>> RetiredRegionTables;
+        std::vector<std::unique_ptr<ChunkRegion>> RetiredRegions;
+
+        struct RegionReadGuard;
+
+        ChunkPool Pool;
+        size_t MemoryBudget = 0;
+        std::atomic<uint32_t> Tick = 1;
+
+        int32_t MinChunkLayer = 0;
+        int32_t MaxChunkLayer = 0;
+
+        // region slots for sky chunks point at this instead of a real chunk
+        static Chunk SkyChunkMarker;
+
+        // region table slots of removed regions point at this
+        static ChunkRegion RemovedRegionMarker;
+
+        std::atomic<Chunk*>* FindSlot(int32_t h, int32_t v, int32_t d) const;
+        ChunkRegion* FindRegion(int32_t regionH, int32_t regionV, int32_t regionD) const;
+        ChunkRegion& AddRegion(int32_t regionH, int32_t regionV, int32_t regionD);
+        void RebuildRegionTable(size_t capacity);
+        void RemoveEmptyRegions();
+        void FreeRetiredRegions();
+
+        static void WrapBlock(ChunkId& chunk, int& h, int& v, int& d);
+
+        std::atomic<Chunk*>& GetOrAddSlot(int32_t h, int32_t v, int32_t d);
+
+        // the local box is the inclusive part of the edit inside the chunk
+        using ChunkEditFunction = std::function<void(Chunk& chunk, const BlockPosition& chunkOrigin, const ChunkEditBox& box)>;
+
+        void EditChunks(const BlockPosition& min, const BlockPosition& max, bool addSkyChunks, DirtyChunkSet* dirtyChunks, const ChunkEditFunction& func);
+        ChunkHandle PinChunkForEdit(ChunkId id, bool addSkyChunk);
+        void MarkDirty(ChunkId id, const ChunkEditBox& box, DirtyChunkSet* dirtyChunks);
 
+        static size_t HashRegion(int32_t regionH, int32_t regionV, int32_t regionD, size_t capacity);
     };
-}
+}
\ No newline at end of file
@@ -18,8 +18,11 @@ namespace Voxels
         ~WorldBuilder();
 
         void SetTerrainGenerationFunction(std::function<void(Chunk&)> func);
-        void SetPopulateFunction(std::function<void(Chunk&)> func);
+        // population runs once the chunks around a chunk are generated, it gets the world so
+        // decorations can spill into those neighbors
+        void SetPopulateFunction(std::function<void(World&, Chunk&)> func);
 
+        // drops every queued and finished chunk and waits for the ones being built
         void Abort();
 
         void PushChunk(ChunkId chunk);
@@ -46,7 +49,7 @@ namespace Voxels
         std::deque<ChunkId> CompletedChunks;
 
         std::function<void(Chunk&)> TerrainGenerationFunction;
-        std::function<void(Chunk&)> PopulationGenerationFunction;
+        std::function<void(World&, Chunk&)> PopulationGenerationFunction;
 
         std::thread WorkerThread; // pool this?
 
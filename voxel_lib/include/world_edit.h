@@ -0,0 +1,68 @@
+// C library
+/*
+-- Copyright (c) 2020-2024 Jeffery Myers
+--
+--This software is provided "as-is", without any express or implied warranty. In no event
+--will the authors be held liable for any damages arising from the use of this software.
+
+--Permission is granted to anyone to use this software for any purpose, including commercial
+--applications, and to alter it and redistribute it freely, subject to the following restrictions:
+
+--  1. The origin of this software must not be misrepresented; you must not claim that you
+--  wrote the original software. If you use this software in a product, an acknowledgment
+--  in the product documentation would be appreciated but is not required.
+--
+--  2. Altered source versions must be plainly marked as such, and must not be misrepresented
+--  as being the original software.
+--
+--  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "block_storage.h"
+
+#include <set>
+#include <vector>
+
+namespace Voxels
+{
+    // a block in world space, h and v across the ground and d up
+    struct BlockPosition
+    {
+        int64_t H = 0;
+        int64_t V = 0;
+        int64_t D = 0;
+    };
+
+    // inclusive range of blocks inside one chunk
+    struct ChunkEditBox
+    {
+        int MinH = 0;
+        int MinV = 0;
+        int MinD = 0;
+        int MaxH = 0;
+        int MaxV = 0;
+        int MaxD = 0;
+    };
+
+    // ids of the chunks that need new meshes after an edit
+    using DirtyChunkSet = std::set<uint64_t>;
+
+    // a prefab stored as indexes into a small palette, h changes fastest, then v, then d
+    // palette entries set to InvalidBlock are holes and leave the world unchanged
+    struct Schematic
+    {
+        int SizeH = 0;
+        int SizeV = 0;
+        int SizeD = 0;
+
+        std::vector<BlockType> Palette;
+        std::vector<uint8_t> Blocks;
+
+        size_t GetIndex(int h, int v, int d) const
+        {
+            return (size_t(d) * SizeV + v) * SizeH + h;
+        }
+    };
+}
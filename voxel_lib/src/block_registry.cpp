@@ -0,0 +1,63 @@
+#include "block_registry.h"
+
+namespace Voxels
+{
+    void BlockRegistry::SetBlock(BlockType blockId, const Rectangle faceUVs[6], bool solid, bool opaque)
+    {
+        if (Frozen)
+        {
+            TraceLog(LOG_WARNING, "Block %d can not be changed after the registry is frozen", int(blockId));
+            return;
+        }
+
+        if (blockId == InvalidBlock)
+            return;
+
+        for (int i = 0; i < 6; i++)
+        {
+            FaceUVs[blockId][i] = faceUVs[i];
+            FaceTiles[blockId][i] = AtlasTile{ uint8_t(faceUVs[i].x * AtlasColumns + 0.5f), uint8_t(faceUVs[i].y * AtlasRows + 0.5f) };
+        }
+
+        Defined[blockId] = true;
+        Solid[blockId] = solid;
+        Opaque[blockId] = opaque;
+    }
+
+    void BlockRegistry::SetBlocks(const BlockDefinition* definitions, size_t count, int atlasColumns, int atlasRows)
+    {
+        AtlasColumns = atlasColumns;
+        AtlasRows = atlasRows;
+
+        float tileWidth = 1.0f / atlasColumns;
+        float tileHeight = 1.0f / atlasRows;
+
+        auto tileRect = [tileWidth, tileHeight](uint8_t x, uint8_t y)
+            {
+                return Rectangle{ x * tileWidth, y * tileHeight, (x + 1) * tileWidth, (y + 1) * tileHeight };
+            };
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const BlockDefinition& definition = definitions[i];
+
+            Rectangle faceUVs[6] = { 0 };
+            if (definition.Solid)
+            {
+                Rectangle side = tileRect(definition.SideTileX, definition.SideTileY);
+                for (int face = 0; face < 6; face++)
+                    faceUVs[face] = side;
+
+                faceUVs[UpFace] = tileRect(definition.TopTileX, definition.TopTileY);
+                faceUVs[DownFace] = tileRect(definition.BottomTileX, definition.BottomTileY);
+            }
+
+            SetBlock(definition.BlockID, faceUVs, definition.Solid, definition.Opaque);
+        }
+    }
+
+    void BlockRegistry::Freeze()
+    {
+        Frozen = true;
+    }
+}
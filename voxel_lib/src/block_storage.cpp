@@ -0,0 +1,317 @@
+#include "block_storage.h"
+
+#include "voxel_lib.h"
+
+#include <algorithm>
+#include <array>
+
+namespace Voxels
+{
+    PalettedBlockStorage::PalettedBlockStorage(size_t blockCount, BlockType fill)
+        : BlockCount(blockCount)
+    {
+        Fill(fill);
+    }
+
+    BlockType PalettedBlockStorage::Get(size_t index) const
+    {
+        if (BitsPerBlock == 0)
+            return Palette[0];
+
+        return Palette[GetIndex(index)];
+    }
+
+    void PalettedBlockStorage::Set(size_t index, BlockType block)
+    {
+        int paletteIndex = AddPaletteIndex(block);
+
+        uint8_t bits = GetBitsForPaletteSize(Palette.size());
+        if (bits != BitsPerBlock)
+            Repack(bits);
+
+        if (BitsPerBlock != 0)
+            SetIndex(index, uint32_t(paletteIndex));
+    }
+
+    void PalettedBlockStorage::FillRun(size_t start, size_t stride, size_t count, BlockType block)
+    {
+        uint32_t paletteIndex = uint32_t(AddPaletteIndex(block));
+
+        uint8_t bits = GetBitsForPaletteSize(Palette.size());
+        if (bits != BitsPerBlock)
+            Repack(bits);
+
+        if (BitsPerBlock == 0 || count == 0)
+            return;
+
+        if (stride != 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                SetIndex(start + i * stride, paletteIndex);
+            return;
+        }
+
+        // the ends of the run share words with other blocks, everything between is whole words
+        const size_t perWord = 32 / BitsPerBlock;
+        size_t index = start;
+        size_t end = start + count;
+
+        for (; index < end && index % perWord != 0; index++)
+            SetIndex(index, paletteIndex);
+
+        uint32_t pattern = RepeatIndex(paletteIndex);
+        for (; index + perWord <= end; index += perWord)
+            Words[index / perWord] = pattern;
+
+        for (; index < end; index++)
+            SetIndex(index, paletteIndex);
+    }
+
+    void PalettedBlockStorage::SetRun(size_t start, size_t stride, size_t count, const BlockType* blocks)
+    {
+        // add every new type before packing anything so the indexes are only repacked once
+        int16_t lookup[256];
+        std::fill(lookup, lookup + 256, int16_t(-1));
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (blocks[i] != InvalidBlock && lookup[blocks[i]] < 0)
+                lookup[blocks[i]] = int16_t(AddPaletteIndex(blocks[i]));
+        }
+
+        uint8_t bits = GetBitsForPaletteSize(Palette.size());
+        if (bits != BitsPerBlock)
+            Repack(bits);
+
+        if (BitsPerBlock == 0)
+            return;
+
+        if (stride != 1)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                if (blocks[i] != InvalidBlock)
+                    SetIndex(start + i * stride, uint32_t(lookup[blocks[i]]));
+            }
+            return;
+        }
+
+        // build each word's new bits and the mask of what changed, then write the word once
+        const size_t perWord = 32 / BitsPerBlock;
+        const uint32_t indexMask = (1u << BitsPerBlock) - 1;
+
+        size_t i = 0;
+        while (i < count)
+        {
+            size_t wordIndex = (start + i) / perWord;
+            uint32_t mask = 0;
+            uint32_t value = 0;
+
+            for (; i < count && (start + i) / perWord == wordIndex; i++)
+            {
+                if (blocks[i] == InvalidBlock)
+                    continue;
+
+                uint32_t shift = uint32_t(((start + i) % perWord) * BitsPerBlock);
+                mask |= indexMask << shift;
+                value |= uint32_t(lookup[blocks[i]]) << shift;
+            }
+
+            Words[wordIndex] = (Words[wordIndex] & ~mask) | value;
+        }
+    }
+
+    bool PalettedBlockStorage::IsSingleType(BlockType* block) const
+    {
+        uint32_t paletteIndex = 0;
+        if (BitsPerBlock != 0)
+        {
+            // unused bits after the last block are zero, so a partly used last word can only miss a match
+            paletteIndex = GetIndex(0);
+            uint32_t pattern = RepeatIndex(paletteIndex);
+            if (std::any_of(Words.begin(), Words.end(), [pattern](uint32_t word) { return word != pattern; }))
+                return false;
+        }
+
+        if (block)
+            *block = Palette[paletteIndex];
+        return true;
+    }
+
+    void PalettedBlockStorage::Fill(BlockType block)
+    {
+        Palette.clear();
+        Palette.push_back(block);
+        BitsPerBlock = 0;
+
+        Words.clear();
+        Words.shrink_to_fit();
+    }
+
+    void PalettedBlockStorage::Decode(BlockType* blocks) const
+    {
+        if (BitsPerBlock == 0)
+        {
+            std::fill(blocks, blocks + BlockCount, Palette[0]);
+            return;
+        }
+
+        const uint32_t perWord = 32 / BitsPerBlock;
+        const uint32_t mask = (1u << BitsPerBlock) - 1;
+
+        size_t index = 0;
+        for (uint32_t word : Words)
+        {
+            for (uint32_t i = 0; i < perWord && index < BlockCount; i++, index++)
+            {
+                blocks[index] = Palette[word & mask];
+                word >>= BitsPerBlock;
+            }
+        }
+    }
+
+    void PalettedBlockStorage::Encode(const BlockType* blocks)
+    {
+        // build a tight palette from the types that are actually used
+        int16_t lookup[256];
+        std::fill(lookup, lookup + 256, int16_t(-1));
+
+        Palette.clear();
+        for (size_t i = 0; i < BlockCount; i++)
+        {
+            if (lookup[blocks[i]] < 0)
+            {
+                lookup[blocks[i]] = int16_t(Palette.size());
+                Palette.push_back(blocks[i]);
+            }
+        }
+
+        if (Palette.empty())
+            Palette.push_back(0);
+
+        BitsPerBlock = GetBitsForPaletteSize(Palette.size());
+        Words.clear();
+
+        if (BitsPerBlock == 0)
+        {
+            Words.shrink_to_fit();
+            return;
+        }
+
+        const uint32_t perWord = 32 / BitsPerBlock;
+        Words.resize((BlockCount + perWord - 1) / perWord);
+        Words.shrink_to_fit();
+
+        size_t index = 0;
+        for (uint32_t& word : Words)
+        {
+            uint32_t packed = 0;
+            for (uint32_t i = 0; i < perWord && index < BlockCount; i++, index++)
+                packed |= uint32_t(lookup[blocks[index]]) << (i * BitsPerBlock);
+
+            word = packed;
+        }
+    }
+
+    size_t PalettedBlockStorage::GetMemoryUsage() const
+    {
+        return sizeof(PalettedBlockStorage) + Palette.capacity() * sizeof(BlockType) + Words.capacity() * sizeof(uint32_t);
+    }
+
+    int PalettedBlockStorage::FindPaletteIndex(BlockType block) const
+    {
+        for (size_t i = 0; i < Palette.size(); i++)
+        {
+            if (Palette[i] == block)
+                return int(i);
+        }
+        return -1;
+    }
+
+    int PalettedBlockStorage::AddPaletteIndex(BlockType block)
+    {
+        int paletteIndex = FindPaletteIndex(block);
+        if (paletteIndex >= 0)
+            return paletteIndex;
+
+        // the caller repacks once it has added everything it needs
+        Palette.push_back(block);
+        return int(Palette.size() - 1);
+    }
+
+    uint32_t PalettedBlockStorage::RepeatIndex(uint32_t value) const
+    {
+        uint32_t pattern = 0;
+        for (uint32_t shift = 0; shift < 32; shift += BitsPerBlock)
+            pattern |= value << shift;
+        return pattern;
+    }
+
+    uint32_t PalettedBlockStorage::GetIndex(size_t index) const
+    {
+        size_t bit = index * BitsPerBlock;
+        return (Words[bit >> 5] >> (bit & 31)) & ((1u << BitsPerBlock) - 1);
+    }
+
+    void PalettedBlockStorage::SetIndex(size_t index, uint32_t value)
+    {
+        size_t bit = index * BitsPerBlock;
+        uint32_t mask = ((1u << BitsPerBlock) - 1) << (bit & 31);
+
+        uint32_t& word = Words[bit >> 5];
+        word = (word & ~mask) | (value << (bit & 31));
+    }
+
+    void PalettedBlockStorage::Repack(uint8_t bits)
+    {
+        // widths are powers of two so an index never straddles two words
+        const uint32_t perWord = 32 / bits;
+        std::vector<uint32_t> newWords((BlockCount + perWord - 1) / perWord, 0);
+
+        if (BitsPerBlock != 0)
+        {
+            for (size_t i = 0; i < BlockCount; i++)
+            {
+                size_t bit = i * bits;
+                newWords[bit >> 5] |= GetIndex(i) << (bit & 31);
+            }
+        }
+
+        Words.swap(newWords);
+        BitsPerBlock = bits;
+    }
+
+    uint8_t PalettedBlockStorage::GetBitsForPaletteSize(size_t size)
+    {
+        if (size <= 1)
+            return 0;
+        if (size <= 2)
+            return 1;
+        if (size <= 4)
+            return 2;
+        if (size <= 16)
+            return 4;
+        return 8;
+    }
+
+    ChunkSection::ChunkSection(size_t blockCount, BlockType fill)
+        : Blocks(blockCount, fill)
+    {
+    }
+
+    const std::shared_ptr<ChunkSection>& ChunkSection::GetUniform(BlockType block)
+    {
+        static const std::array<std::shared_ptr<ChunkSection>, 256> uniformSections = []()
+            {
+                std::array<std::shared_ptr<ChunkSection>, 256> sections;
+                for (size_t i = 0; i < sections.size(); i++)
+                {
+                    sections[i] = std::make_shared<ChunkSection>(Chunk::SectionBlockCount, BlockType(i));
+                    sections[i]->Shared = true;
+                }
+                return sections;
+            }();
+
+        return uniformSections[block];
+    }
+}
@@ -4,10 +4,12 @@
 
 namespace Voxels
 {
-    ChunkMesher::ChunkMesher(World& world, ChunkId chunk)
+    ChunkMesher::ChunkMesher(World& world, ChunkId chunk, MeshingMode mode, CubeGeometryBuilder::VertexFormat format, int lod)
         : Map(world)
         , MapChunk(chunk)
-        , Builder(ChunkMesh)
+        , Builder(ChunkMesh, format)
+        , Mode(mode)
+        , Lod(GetLodScale(lod) > 1 ? std::min(lod, MaxLod) : 0)
     {
         SetStatus(Status::Unbuilt);
     }
@@ -16,87 +18,525 @@ namespace Voxels
     {
         SetStatus(Status::Building);
 
-        Builder.Allocate(GetChunkFaceCount());
+        Neighborhood.Capture(Map, MapChunk);
+        ComputeMeshBounds();
 
-        size_t count = 0;
-        for (int d = 0; d < Chunk::ChunkHeight; d++)
+        if (Lod > 0)
+            BuildLodMesh();
+        else if (Mode == MeshingMode::Greedy)
+            BuildGreedyMesh();
+        else
+            BuildFaceMesh();
+
+        SetStatus(Status::Built);
+    }
+
+    void ChunkMesher::ComputeMeshBounds()
+    {
+        constexpr int size = Chunk::ChunkSize;
+
+        // only solid blocks get faces, so every quad is between the lowest and highest solid block
+        uint64_t solid = 0;
+        for (int v = 0; v < size; v++)
         {
-            for (int v = 0; v < Chunk::ChunkSize; v++)
-            {
-                for (int h = 0; h < Chunk::ChunkSize; h++)
-                {
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d))
-                        continue;
+            for (int h = 0; h < size; h++)
+                solid |= uint64_t(Neighborhood.GetSolidColumn(h, v));
+        }
 
-                    // build up the list of faces that this block needs
-                    bool faces[6] = { false, false, false, false, false, false };
+        MeshBounds = BoundingBox{ Vector3{ 0, 0, 0 }, Vector3{ float(size), 0, float(size) } };
+        if (solid == 0)
+            return;
 
-                    if (!Map.BlockIsSolid(MapChunk, h - 1, v, d))
-                        faces[EastFace] = true;
+        // low detail cells cover scale blocks, so the box is rounded out to whole cells
+        int scale = GetLodScale(Lod);
+        int minD = FindLowestBit(solid) / scale * scale;
+        int maxD = (FindHighestBit(solid) / scale + 1) * scale;
 
-                    if (!Map.BlockIsSolid(MapChunk, h + 1, v, d))
-                        faces[WestFace] = true;
+        MeshBounds.min.y = float(minD);
+        MeshBounds.max.y = float(maxD);
+    }
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v - 1, d))
-                        faces[NorthFace] = true;
+    void ChunkMesher::BuildFaceMesh()
+    {
+        constexpr int size = Chunk::ChunkSize;
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v + 1, d))
-                        faces[SouthFace] = true;
+        Chunk::ColumnMask columnFaces[size * size][6];
+        for (int v = 0; v < size; v++)
+        {
+            for (int h = 0; h < size; h++)
+                Neighborhood.GetColumnFaces(h, v, columnFaces[Chunk::GetColumnIndex(h, v)]);
+        }
+
+        // one pass over the columns for each face direction, the builder grows its scratch buffers as faces are added
+        Builder.Begin();
+
+        FaceIndex = std::make_shared<ChunkFaceIndex>();
+        MeshFaceRanges ranges;
+
+        size_t faceCount = 0;
+        for (auto& column : columnFaces)
+        {
+            for (Chunk::ColumnMask faces : column)
+                faceCount += CountBits(faces);
+        }
+        FaceIndex->Reserve(faceCount);
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d + 1))
-                        faces[UpFace] = true;
+        uint32_t slot = 0;
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d - 1))
-                        faces[DownFace] = true;
+        for (int face = 0; face < 6; face++)
+        {
+            BeginFaceRange(ranges, face);
 
-                    // build the faces that hit open air for this voxel block
-                    Builder.AddCube(Vector3{ (float)h, (float)d, (float)v }, faces, Map.GetVoxel(MapChunk,h, v, d));
+            for (int v = 0; v < size; v++)
+            {
+                for (int h = 0; h < size; h++)
+                {
+                    // walk only the blocks in this column that have this face open, and remember where each one went
+                    uint64_t blocks = uint64_t(columnFaces[Chunk::GetColumnIndex(h, v)][face]);
+                    while (blocks != 0)
+                    {
+                        int d = FindLowestBit(blocks);
+                        blocks &= blocks - 1;
+
+                        Vector3 position = { (float)h, (float)d, (float)v };
+                        FaceIndex->Set(h, v, d, face, slot++);
+                        Builder.AddFace(position, face, GetVoxel(h, v, d));
+                    }
                 }
             }
+
+            EndFaceRange(ranges, face);
         }
 
-        SetStatus(Status::Built);
+        // the spare quads are zeroed by the allocation, none are drawn until a patch uses one
+        // chunks with no faces get no spares either, so they need no mesh at all and the first block placed remeshes them
+        int spareFaces = slot > 0 ? SpareFaces : 0;
+        Builder.Finish(spareFaces);
+        FaceIndex->AddFreeSlots(slot, uint32_t(spareFaces));
+
+        ranges.First[MeshFaceRanges::AnyFace] = slot;
+        ranges.Count[MeshFaceRanges::AnyFace] = 0;
+        ChunkMesh.GetFaceRanges() = ranges;
     }
 
-    int ChunkMesher::GetChunkFaceCount()
+    void ChunkMesher::BuildGreedyMesh()
     {
-        int count = 0;
-        for (int d = 0; d < Chunk::ChunkHeight; d++)
+        constexpr int size = Chunk::ChunkSize;
+
+        Chunk::ColumnMask columnFaces[size * size][6];
+        for (int v = 0; v < size; v++)
         {
-            for (int v = 0; v < Chunk::ChunkSize; v++)
+            for (int h = 0; h < size; h++)
+                Neighborhood.GetColumnFaces(h, v, columnFaces[Chunk::GetColumnIndex(h, v)]);
+        }
+
+        Builder.Begin();
+
+        MeshFaceRanges ranges;
+        MergeFaces(size, Chunk::ChunkHeight, 1, [&](int face, int h, int v, int d)
             {
-                for (int h = 0; h < Chunk::ChunkSize; h++)
+                bool visible = (columnFaces[Chunk::GetColumnIndex(h, v)][face] & (Chunk::ColumnMask(1) << d)) != 0;
+                return visible ? GetVoxel(h, v, d) : InvalidBlock;
+            }, ranges);
+
+        Builder.Finish();
+        ChunkMesh.GetFaceRanges() = ranges;
+
+        // greedy meshes have no face index, so edits fall back to a remesh
+        FaceIndex.reset();
+    }
+
+    template <class GetFace>
+    void ChunkMesher::MergeFaces(int size, int height, int scale, GetFace getFace, MeshFaceRanges& ranges)
+    {
+        // each slice is a 2d grid of the block that owns each visible face, InvalidBlock where there is no face
+        BlockType slice[Chunk::ChunkSize * (Chunk::ChunkSize > Chunk::ChunkHeight ? Chunk::ChunkSize : Chunk::ChunkHeight)];
+
+        for (int face = 0; face < 6; face++)
+        {
+            BeginFaceRange(ranges, face);
+
+            // up and down faces are sliced by depth, the sides by the axis they face along
+            bool flat = face == UpFace || face == DownFace;
+            bool alongH = face == WestFace || face == EastFace;
+
+            // cells run along h or v first, rows are v for flat faces and d for the sides
+            int sliceCount = flat ? height : size;
+            int width = size;
+            int rows = flat ? size : height;
+
+            // maps a slice and a cell in it back to chunk coordinates
+            auto getBlock = [&](int layer, int a, int b, int& h, int& v, int& d)
+                {
+                    if (flat)
+                    {
+                        h = a; v = b; d = layer;
+                    }
+                    else if (alongH)
+                    {
+                        h = layer; v = a; d = b;
+                    }
+                    else
+                    {
+                        h = a; v = layer; d = b;
+                    }
+                };
+
+            for (int layer = 0; layer < sliceCount; layer++)
+            {
+                bool any = false;
+                for (int b = 0; b < rows; b++)
                 {
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d))
-                        continue;
+                    for (int a = 0; a < width; a++)
+                    {
+                        int h, v, d;
+                        getBlock(layer, a, b, h, v, d);
+
+                        BlockType block = getFace(face, h, v, d);
+                        slice[b * width + a] = block;
+                        any |= block != InvalidBlock;
+                    }
+                }
+
+                if (!any)
+                    continue;
 
-                    if (!Map.BlockIsSolid(MapChunk, h + 1, v, d))
-                        count++;
+                for (int b = 0; b < rows; b++)
+                {
+                    for (int a = 0; a < width; a++)
+                    {
+                        BlockType block = slice[b * width + a];
+                        if (block == InvalidBlock)
+                            continue;
+
+                        // grow along a as far as the block runs, then along b while whole rows match
+                        int quadWidth = 1;
+                        while (a + quadWidth < width && slice[b * width + a + quadWidth] == block)
+                            quadWidth++;
+
+                        int quadRows = 1;
+                        for (; b + quadRows < rows; quadRows++)
+                        {
+                            const BlockType* row = slice + (b + quadRows) * width + a;
+                            if (!std::all_of(row, row + quadWidth, [block](BlockType other) { return other == block; }))
+                                break;
+                        }
+
+                        for (int clearB = b; clearB < b + quadRows; clearB++)
+                            std::fill(slice + clearB * width + a, slice + clearB * width + a + quadWidth, InvalidBlock);
+
+                        int h, v, d;
+                        getBlock(layer, a, b, h, v, d);
+
+                        // cells are scale blocks on a side, the quad is one cell thick along its normal
+                        Vector3 position = { float(h * scale), float(d * scale), float(v * scale) };
+                        Vector3 quadSize;
+                        if (flat)
+                            quadSize = Vector3{ float(quadWidth), 1, float(quadRows) };
+                        else if (alongH)
+                            quadSize = Vector3{ 1, float(quadRows), float(quadWidth) };
+                        else
+                            quadSize = Vector3{ float(quadWidth), float(quadRows), 1 };
+
+                        quadSize = Vector3{ quadSize.x * scale, quadSize.y * scale, quadSize.z * scale };
+
+                        Builder.AddQuad(position, face, block, quadSize);
+                    }
+                }
+            }
 
-                    if (!Map.BlockIsSolid(MapChunk, h - 1, v, d))
-                        count++;
+            EndFaceRange(ranges, face);
+        }
+    }
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v + 1, d))
-                        count++;
+    void ChunkMesher::BuildLodMesh()
+    {
+        constexpr int size = Chunk::ChunkSize;
+        constexpr int height = Chunk::ChunkHeight;
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v - 1, d))
-                        count++;
+        const int scale = GetLodScale(Lod);
+        const int cellsWide = size / scale;
+        const int cellsHigh = height / scale;
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d + 1))
-                        count++;
+        auto getCell = [cellsWide](int h, int v, int d) { return (d * cellsWide + v) * cellsWide + h; };
 
-                    if (!Map.BlockIsSolid(MapChunk, h, v, d - 1))
-                        count++;
+        // each cell is a cube of scale blocks, it is solid when at least half its blocks are
+        // and it is drawn as the highest solid block in it, so grass stays on top
+        BlockType cells[Chunk::BlockCount / 8];
+        for (int cellD = 0; cellD < cellsHigh; cellD++)
+        {
+            for (int cellV = 0; cellV < cellsWide; cellV++)
+            {
+                for (int cellH = 0; cellH < cellsWide; cellH++)
+                {
+                    int solidCount = 0;
+                    BlockType top = InvalidBlock;
+                    for (int d = (cellD + 1) * scale - 1; d >= cellD * scale; d--)
+                    {
+                        for (int v = cellV * scale; v < (cellV + 1) * scale; v++)
+                        {
+                            for (int h = cellH * scale; h < (cellH + 1) * scale; h++)
+                            {
+                                BlockType block = GetVoxel(h, v, d);
+                                if (!BlockRegistry::IsSolid(block))
+                                    continue;
+
+                                solidCount++;
+                                if (top == InvalidBlock)
+                                    top = block;
+                            }
+                        }
+                    }
+
+                    cells[getCell(cellH, cellV, cellD)] = solidCount * 2 >= scale * scale * scale ? top : InvalidBlock;
                 }
             }
         }
 
-        return count;
+        // cells past the top and bottom use the border blocks of the chunks above and below, half solid is solid
+        auto borderIsSolid = [this, scale](int cellH, int cellV, int d)
+            {
+                int solidCount = 0;
+                for (int v = cellV * scale; v < (cellV + 1) * scale; v++)
+                {
+                    for (int h = cellH * scale; h < (cellH + 1) * scale; h++)
+                        solidCount += Neighborhood.BlockIsSolid(h, v, d) ? 1 : 0;
+                }
+                return solidCount * 2 >= scale * scale;
+            };
+
+        // offset to the cell each face looks at, indexed by face
+        static constexpr int FaceNeighbors[6][3] =
+        {
+            { 0, 1, 0 },    // SouthFace
+            { 0, -1, 0 },   // NorthFace
+            { 1, 0, 0 },    // WestFace
+            { -1, 0, 0 },   // EastFace
+            { 0, 0, 1 },    // UpFace
+            { 0, 0, -1 },   // DownFace
+        };
+
+        auto getFace = [&](int face, int cellH, int cellV, int cellD)
+            {
+                BlockType block = cells[getCell(cellH, cellV, cellD)];
+                if (block == InvalidBlock)
+                    return InvalidBlock;
+
+                int h = cellH + FaceNeighbors[face][0];
+                int v = cellV + FaceNeighbors[face][1];
+                int d = cellD + FaceNeighbors[face][2];
+
+                // side faces on the chunk edge are always drawn, they are skirts that hide the gaps
+                // where a neighbor at a different level of detail has a different surface height
+                bool covered = false;
+                if (d < 0)
+                    covered = borderIsSolid(cellH, cellV, -1);
+                else if (d >= cellsHigh)
+                    covered = borderIsSolid(cellH, cellV, height);
+                else if (h >= 0 && h < cellsWide && v >= 0 && v < cellsWide)
+                    covered = cells[getCell(h, v, d)] != InvalidBlock;
+
+                return covered ? InvalidBlock : block;
+            };
+
+        Builder.Begin();
+
+        MeshFaceRanges ranges;
+        if (Mode == MeshingMode::Greedy)
+        {
+            MergeFaces(cellsWide, cellsHigh, scale, getFace, ranges);
+        }
+        else
+        {
+            Vector3 cellSize = { float(scale), float(scale), float(scale) };
+            for (int face = 0; face < 6; face++)
+            {
+                BeginFaceRange(ranges, face);
+                for (int cellD = 0; cellD < cellsHigh; cellD++)
+                {
+                    for (int cellV = 0; cellV < cellsWide; cellV++)
+                    {
+                        for (int cellH = 0; cellH < cellsWide; cellH++)
+                        {
+                            BlockType block = getFace(face, cellH, cellV, cellD);
+                            if (block == InvalidBlock)
+                                continue;
+
+                            Vector3 position = { float(cellH * scale), float(cellD * scale), float(cellV * scale) };
+                            Builder.AddQuad(position, face, block, cellSize);
+                        }
+                    }
+                }
+                EndFaceRange(ranges, face);
+            }
+        }
+
+        Builder.Finish();
+        ChunkMesh.GetFaceRanges() = ranges;
+
+        // low detail meshes have no face index, edits remesh them
+        FaceIndex.reset();
+    }
+
+    bool ChunkMesher::PatchBlock(World& world, Chunk& chunk, int h, int v, int d)
+    {
+        ChunkFaceIndex* faceIndex = chunk.MeshFaces.get();
+        Mesh& mesh = chunk.ChunkMesh;
+        if (!faceIndex || mesh.vaoId == 0)
+            return false;
+
+        // offset to the block each face looks at, indexed by face
+        static constexpr int FaceNeighbors[6][3] =
+        {
+            { 0, 1, 0 },    // SouthFace
+            { 0, -1, 0 },   // NorthFace
+            { 1, 0, 0 },    // WestFace
+            { -1, 0, 0 },   // EastFace
+            { 0, 0, 1 },    // UpFace
+            { 0, 0, -1 },   // DownFace
+        };
+
+        BlockType block = chunk.GetVoxel(h, v, d);
+        bool solid = BlockRegistry::IsSolid(block);
+
+        // work out the changes first, so a mesh is never left half patched
+        bool wanted[6] = { false };
+        uint32_t slots[6] = { 0 };
+
+        // new faces take a slot freed in their own direction's range or a spare one, faces removed here can't
+        // make room for them since they are in other directions
+        size_t spareNeeded = 0;
+
+        for (int face = 0; face < 6; face++)
+        {
+            const int* offset = FaceNeighbors[face];
+            wanted[face] = solid && !world.BlockIsSolid(chunk.Id, h + offset[0], v + offset[1], d + offset[2]);
+            slots[face] = faceIndex->Find(h, v, d, face);
+
+            if (wanted[face] && slots[face] == ChunkFaceIndex::NoSlot && faceIndex->GetFreeSlotCount(face) == 0)
+                spareNeeded++;
+        }
+
+        // the remesh this falls back to gets a bigger spare pool
+        if (spareNeeded > faceIndex->GetSpareSlotCount())
+        {
+            chunk.MeshSpareFaces = GetSpareFaceCount(int(faceIndex->GetSparePoolSize()) * 2);
+            return false;
+        }
+
+        // the uploaded mesh has no CPU copy, each face is built into a one quad buffer and sent over its slot
+        MeshBuffer faceData;
+        CubeGeometryBuilder builder(faceData, CubeGeometryBuilder::IsPacked(mesh) ? CubeGeometryBuilder::VertexFormat::Packed : CubeGeometryBuilder::VertexFormat::Float);
+        builder.Allocate(1, mesh.indices != nullptr);
+
+        // free the faces that are gone before taking slots for new ones
+        for (int face = 0; face < 6; face++)
+        {
+            if (wanted[face] || slots[face] == ChunkFaceIndex::NoSlot)
+                continue;
+
+            builder.ClearFace(0);
+            CubeGeometryBuilder::UpdateFaces(mesh, faceData.GetMesh(), slots[face], 1);
+
+            faceIndex->Remove(h, v, d, face);
+            faceIndex->FreeSlot(slots[face], face);
+        }
+
+        // new faces and faces whose block type may have changed are written again
+        Vector3 position = { float(h), float(d), float(v) };
+        for (int face = 0; face < 6; face++)
+        {
+            if (!wanted[face])
+                continue;
+
+            uint32_t slot = slots[face];
+            if (slot == ChunkFaceIndex::NoSlot)
+            {
+                slot = faceIndex->TakeFreeSlot(face);
+                faceIndex->Set(h, v, d, face, slot);
+
+                // spares are handed out lowest first, the drawn part of the spare range grows to cover the new one
+                MeshFaceRanges& ranges = chunk.ChunkMeshFaces;
+                if (slot >= ranges.First[MeshFaceRanges::AnyFace])
+                    ranges.Count[MeshFaceRanges::AnyFace] = std::max(ranges.Count[MeshFaceRanges::AnyFace], slot - ranges.First[MeshFaceRanges::AnyFace] + 1);
+            }
+
+            builder.SetFaceSlot(0);
+            builder.AddFace(position, face, block);
+            CubeGeometryBuilder::UpdateFaces(mesh, faceData.GetMesh(), slot, 1);
+        }
+
+        // a block placed above or below everything else grows the culling box
+        if (solid)
+        {
+            chunk.MeshBounds.min.y = std::min(chunk.MeshBounds.min.y, float(d));
+            chunk.MeshBounds.max.y = std::max(chunk.MeshBounds.max.y, float(d + 1));
+        }
+
+        return true;
     }
 
-    Mesh ChunkMesher::GetMesh()
+    std::vector<ChunkFaceIndex::Entry>::const_iterator ChunkFaceIndex::FindEntry(uint32_t key) const
     {
-        return ChunkMesh;
+        return std::lower_bound(Entries.begin(), Entries.end(), key, [](const Entry& entry, uint32_t key) { return entry.Key < key; });
+    }
+
+    uint32_t ChunkFaceIndex::Find(int h, int v, int d, int face) const
+    {
+        uint32_t key = GetKey(h, v, d, face);
+        auto itr = FindEntry(key);
+        if (itr == Entries.end() || itr->Key != key)
+            return NoSlot;
+
+        return itr->Slot;
+    }
+
+    void ChunkFaceIndex::Set(int h, int v, int d, int face, uint32_t slot)
+    {
+        uint32_t key = GetKey(h, v, d, face);
+
+        // the mesher adds faces in key order
+        if (Entries.empty() || Entries.back().Key < key)
+        {
+            Entries.push_back(Entry{ key, slot });
+            return;
+        }
+
+        auto itr = Entries.begin() + (FindEntry(key) - Entries.cbegin());
+        if (itr != Entries.end() && itr->Key == key)
+            itr->Slot = slot;
+        else
+            Entries.insert(itr, Entry{ key, slot });
+    }
+
+    void ChunkFaceIndex::Remove(int h, int v, int d, int face)
+    {
+        uint32_t key = GetKey(h, v, d, face);
+        auto itr = Entries.begin() + (FindEntry(key) - Entries.cbegin());
+        if (itr != Entries.end() && itr->Key == key)
+            itr->Slot = NoSlot;
+    }
+
+    void ChunkFaceIndex::AddFreeSlots(uint32_t first, uint32_t count)
+    {
+        FirstSpareSlot = first;
+        SparePoolSize = count;
+
+        // hand out the lowest slots first
+        std::vector<uint32_t>& spareSlots = FreeSlots[MeshFaceRanges::AnyFace];
+        for (uint32_t i = count; i > 0; i--)
+            spareSlots.push_back(first + i - 1);
+    }
+
+    uint32_t ChunkFaceIndex::TakeFreeSlot(int face)
+    {
+        std::vector<uint32_t>& freeSlots = FreeSlots[face].empty() ? FreeSlots[MeshFaceRanges::AnyFace] : FreeSlots[face];
+        if (freeSlots.empty())
+            return NoSlot;
+
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
     }
 
     ChunkMesher::Status ChunkMesher::GetStatus() const
@@ -130,24 +570,32 @@ namespace Voxels
         }
         if (WorkerThread.joinable())
             WorkerThread.join();
+
+        std::lock_guard guard(QueueMutex);
+        PendingChunks.clear();
+        PriorityChunks.clear();
+        CompletedChunks.clear();
     }
 
-    void ChunkMeshTaskPool::PushChunk(ChunkId chunk)
+    void ChunkMeshTaskPool::PushChunk(ChunkId chunk, uint32_t epoch, bool highPriority, int lod)
     {
         {
             std::lock_guard guard(QueueMutex);
-            PendingChunks.push_back(chunk);
+            if (highPriority)
+                PriorityChunks.push_back(MeshRequest{ chunk, epoch, lod });
+            else
+                PendingChunks.push_back(MeshRequest{ chunk, epoch, lod });
         }
         StartQueue();
     }
 
-    bool ChunkMeshTaskPool::PopChunk(ChunkId* chunk)
+    bool ChunkMeshTaskPool::PopChunk(CompletedMesh* mesh)
     {
         std::lock_guard guard(QueueMutex);
-        if (CompletedChunks.empty() || !chunk)
+        if (CompletedChunks.empty() || !mesh)
             return false;
 
-        *chunk = CompletedChunks.front();
+        *mesh = std::move(CompletedChunks.front());
         CompletedChunks.pop_front();
         return true;
     }
@@ -174,24 +622,59 @@ namespace Voxels
 
     bool ChunkMeshTaskPool::RunOneTask()
     {
-        ChunkId processChunk;
+        MeshRequest request;
 
-        if (!PopPendingChunk(&processChunk))
+        if (!PopPendingChunk(&request))
         {
             return false;
         }
 
-        ChunkMesher mesher(Map, processChunk);
-        mesher.BuildMesh();
+        ChunkId processChunk = request.Id;
+
+        CompletedMesh completed;
+        completed.Id = processChunk;
+        completed.Epoch = request.Epoch;
 
-        Chunk* chunk = Map.GetChunk(processChunk);
+        auto complete = [this, &completed]()
+            {
+                std::lock_guard outBoundGuard(QueueMutex);
+                CompletedChunks.push_back(std::move(completed));
+            };
 
-        chunk->ChunkMesh = mesher.GetMesh();
-        chunk->SetStatus(ChunkStatus::Meshed);
+        // a chunk that was reused since it was queued is somebody else's now
+        ChunkHandle chunk = Map.PinChunk(processChunk);
+        if (!chunk || chunk->GetEpoch() != request.Epoch)
+        {
+            complete();
+            return true;
+        }
 
-        std::lock_guard outBoundGuard(QueueMutex);
-        CompletedChunks.push_back(processChunk);
+        // edits made after this point will dirty the chunk again
+        chunk->ClearDirty();
 
+        ChunkMesher mesher(Map, processChunk, Mode, Format, request.Lod);
+        mesher.SetSpareFaces(chunk->MeshSpareFaces);
+        mesher.BuildMesh();
+
+        // the mesh goes back in the queue entry, remeshes of drawn chunks are uploaded next to the old mesh
+        bool stale = chunk->GetEpoch() != request.Epoch;
+        if (!stale && (chunk->TryTransition(ChunkStatus::Meshing, ChunkStatus::Meshed) || chunk->GetStatus() == ChunkStatus::Useable))
+        {
+            completed.Built = true;
+            completed.Mesh = mesher.TakeMesh();
+            completed.Faces = mesher.GetFaceIndex();
+            completed.Version = mesher.GetBlockVersion();
+            completed.Lod = mesher.GetLod();
+            completed.Bounds = mesher.GetMeshBounds();
+        }
+        else if (!stale)
+        {
+            // the chunk's mesh was unloaded while this remesh was building, the mesher's buffer goes back to the pool
+            // the dirty flag this request cleared is set again so the chunk is meshed when it is drawn again
+            chunk->MarkDirty();
+        }
+
+        complete();
         return true;
     }
 
@@ -217,17 +700,28 @@ namespace Voxels
         }
     }
 
-    bool ChunkMeshTaskPool::PopPendingChunk(ChunkId* chunk)
+    bool ChunkMeshTaskPool::PopPendingChunk(MeshRequest* request)
     {
         std::lock_guard guard(QueueMutex);
-        if (PendingChunks.empty() || !chunk)
+        if (!request)
+            return false;
+
+        // remeshes already have their neighbors
+        if (!PriorityChunks.empty())
+        {
+            *request = PriorityChunks.front();
+            PriorityChunks.pop_front();
+            return true;
+        }
+
+        if (PendingChunks.empty())
             return false;
 
         for (auto itr = PendingChunks.begin(); itr != PendingChunks.end(); itr++)
         {
-            if (Map.SurroundingChunksGenerated(*itr))
+            if (Map.SurroundingChunksGenerated(itr->Id))
             {
-                *chunk = *itr;
+                *request = *itr;
                 PendingChunks.erase(itr);
                 return true;
             }
@@ -238,7 +732,7 @@ namespace Voxels
     bool ChunkMeshTaskPool::PendingChunksEmpty()
     {
         std::lock_guard guard(QueueMutex);
-        return PendingChunks.empty();
+        return PendingChunks.empty() && PriorityChunks.empty();
     }
 
     void ChunkMeshTaskPool::StopQueue()
@@ -0,0 +1,119 @@
+#include "chunk_neighborhood.h"
+
+#include <algorithm>
+
+namespace Voxels
+{
+    bool ChunkNeighborhood::Capture(World& world, ChunkId id)
+    {
+        std::fill(Blocks, Blocks + BlockCount, InvalidBlock);
+        std::fill(SolidColumns, SolidColumns + Width * Width, Chunk::ColumnMask(0));
+
+        // everything read here is pinned so it can not be evicted part way through
+        ChunkHandle center = world.PinChunk(id);
+        if (!center)
+            return false;
+
+        // snapshots hold the blocks as they were at one moment, edits made while we read go to copies
+        Center = center->TakeSnapshot();
+
+        // the center chunk is decoded once and reordered into the padded layout
+        BlockType chunkBlocks[Chunk::BlockCount];
+        Center.GetBlocks(chunkBlocks);
+
+        for (int d = 0; d < Chunk::ChunkHeight; d++)
+        {
+            for (int v = 0; v < Chunk::ChunkSize; v++)
+            {
+                BlockType* row = Blocks + GetIndex(0, v, d);
+                for (int h = 0; h < Chunk::ChunkSize; h++)
+                    row[h] = chunkBlocks[Chunk::GetIndex(h, v, d)];
+            }
+        }
+
+        // one block border from each neighbor, chunks without storage are sky or not loaded yet
+        ChunkHandle east = world.PinChunk(id.Offset(-1, 0, 0));
+        ChunkHandle west = world.PinChunk(id.Offset(1, 0, 0));
+        ChunkHandle north = world.PinChunk(id.Offset(0, -1, 0));
+        ChunkHandle south = world.PinChunk(id.Offset(0, 1, 0));
+        ChunkHandle up = world.PinChunk(id.Offset(0, 0, 1));
+        ChunkHandle down = world.PinChunk(id.Offset(0, 0, -1));
+
+        ChunkSnapshot eastBlocks = east ? east->TakeSnapshot() : ChunkSnapshot();
+        ChunkSnapshot westBlocks = west ? west->TakeSnapshot() : ChunkSnapshot();
+        ChunkSnapshot northBlocks = north ? north->TakeSnapshot() : ChunkSnapshot();
+        ChunkSnapshot southBlocks = south ? south->TakeSnapshot() : ChunkSnapshot();
+        ChunkSnapshot upBlocks = up ? up->TakeSnapshot() : ChunkSnapshot();
+        ChunkSnapshot downBlocks = down ? down->TakeSnapshot() : ChunkSnapshot();
+
+        BlockType eastFill = world.GetMissingChunkBlock(id.Offset(-1, 0, 0));
+        BlockType westFill = world.GetMissingChunkBlock(id.Offset(1, 0, 0));
+        BlockType northFill = world.GetMissingChunkBlock(id.Offset(0, -1, 0));
+        BlockType southFill = world.GetMissingChunkBlock(id.Offset(0, 1, 0));
+        BlockType upFill = world.GetMissingChunkBlock(id.Offset(0, 0, 1));
+        BlockType downFill = world.GetMissingChunkBlock(id.Offset(0, 0, -1));
+
+        for (int d = 0; d < Chunk::ChunkHeight; d++)
+        {
+            for (int i = 0; i < Chunk::ChunkSize; i++)
+            {
+                Blocks[GetIndex(-1, i, d)] = eastBlocks.IsValid() ? eastBlocks.GetVoxel(Chunk::ChunkSize - 1, i, d) : eastFill;
+                Blocks[GetIndex(Chunk::ChunkSize, i, d)] = westBlocks.IsValid() ? westBlocks.GetVoxel(0, i, d) : westFill;
+                Blocks[GetIndex(i, -1, d)] = northBlocks.IsValid() ? northBlocks.GetVoxel(i, Chunk::ChunkSize - 1, d) : northFill;
+                Blocks[GetIndex(i, Chunk::ChunkSize, d)] = southBlocks.IsValid() ? southBlocks.GetVoxel(i, 0, d) : southFill;
+            }
+        }
+
+        for (int v = 0; v < Chunk::ChunkSize; v++)
+        {
+            for (int h = 0; h < Chunk::ChunkSize; h++)
+            {
+                Blocks[GetIndex(h, v, Chunk::ChunkHeight)] = upBlocks.IsValid() ? upBlocks.GetVoxel(h, v, 0) : upFill;
+                Blocks[GetIndex(h, v, -1)] = downBlocks.IsValid() ? downBlocks.GetVoxel(h, v, Chunk::ChunkHeight - 1) : downFill;
+            }
+        }
+
+        // column masks come straight from the snapshots, missing chunks are all or nothing
+        auto borderColumn = [](const ChunkSnapshot& snapshot, BlockType fill, int h, int v)
+            {
+                if (snapshot.IsValid())
+                    return snapshot.SolidColumns[Chunk::GetColumnIndex(h, v)];
+
+                return BlockRegistry::IsSolid(fill) ? Chunk::FullColumn : Chunk::ColumnMask(0);
+            };
+
+        for (int v = 0; v < Chunk::ChunkSize; v++)
+        {
+            for (int h = 0; h < Chunk::ChunkSize; h++)
+                SolidColumns[((v + 1) * Width) + (h + 1)] = Center.SolidColumns[Chunk::GetColumnIndex(h, v)];
+        }
+
+        for (int i = 0; i < Chunk::ChunkSize; i++)
+        {
+            SolidColumns[((i + 1) * Width)] = borderColumn(eastBlocks, eastFill, Chunk::ChunkSize - 1, i);
+            SolidColumns[((i + 1) * Width) + Width - 1] = borderColumn(westBlocks, westFill, 0, i);
+            SolidColumns[i + 1] = borderColumn(northBlocks, northFill, i, Chunk::ChunkSize - 1);
+            SolidColumns[((Width - 1) * Width) + (i + 1)] = borderColumn(southBlocks, southFill, i, 0);
+        }
+
+        return true;
+    }
+
+    void ChunkNeighborhood::GetColumnFaces(int h, int v, Chunk::ColumnMask faces[6]) const
+    {
+        constexpr Chunk::ColumnMask topBit = Chunk::ColumnMask(1) << (Chunk::ChunkHeight - 1);
+
+        Chunk::ColumnMask solid = GetSolidColumn(h, v);
+
+        // shift the column by one so each bit lines up with the block above or below it
+        Chunk::ColumnMask above = (solid >> 1) | (BlockIsSolid(h, v, Chunk::ChunkHeight) ? topBit : 0);
+        Chunk::ColumnMask below = Chunk::ColumnMask(solid << 1) | (BlockIsSolid(h, v, -1) ? 1 : 0);
+
+        faces[UpFace] = solid & ~above;
+        faces[DownFace] = solid & ~below;
+        faces[EastFace] = solid & ~GetSolidColumn(h - 1, v);
+        faces[WestFace] = solid & ~GetSolidColumn(h + 1, v);
+        faces[NorthFace] = solid & ~GetSolidColumn(h, v - 1);
+        faces[SouthFace] = solid & ~GetSolidColumn(h, v + 1);
+    }
+}
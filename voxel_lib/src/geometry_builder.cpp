@@ -3,252 +3,550 @@
 #include "geometry_builder.h"
 #include "voxel_lib.h"
 
+#include "raymath.h"
+#include "rlgl.h"
+
+#include <algorithm>
 #include <map>
+#include <utility>
+#include <vector>
 
 using namespace Voxels;
 
-// setup the builder with the mesh it is going to fill out
-CubeGeometryBuilder::CubeGeometryBuilder(Mesh& mesh) : MeshRef(mesh)
+namespace
+{
+    // per thread vertex storage for meshes built with Begin, it only ever grows
+    struct ScratchBuffers
+    {
+        std::vector<float> Vertices;
+        std::vector<float> Normals;
+        std::vector<float> TexCoords;
+        std::vector<float> TexCoords2;
+        std::vector<unsigned char> Packed;
+    };
+
+    thread_local ScratchBuffers Scratch;
+
+    // the corners of a quad in the order they are written
+    constexpr int IndexedOrder[4] = { 0, 1, 2, 3 };
+    constexpr int TriangleOrder[6] = { 0, 1, 2, 0, 2, 3 };
+}
+
+// setup the builder with the buffer it is going to fill out
+CubeGeometryBuilder::CubeGeometryBuilder(MeshBuffer& output, VertexFormat format) : Output(output), Format(format)
 {
 }
 
-// we need to know how many triangles are going to be in the mesh before we start
+// we need to know how many faces are going to be in the mesh before we start
 // this way we can allocate the correct buffer sizes for the mesh
-void CubeGeometryBuilder::Allocate(int triangles)
+void CubeGeometryBuilder::Allocate(int faces, bool allowIndices)
 {
-    // there are 
-    MeshRef.vertexCount = triangles * 6;
-    MeshRef.triangleCount = triangles * 2;
+    // faces share the static quad index buffer when it is big enough, otherwise each face is two whole triangles
+    Indexed = allowIndices && faces <= MaxIndexedQuads;
 
-    MeshRef.vertices = static_cast<float*>(MemAlloc(sizeof(float) * 3 * MeshRef.vertexCount));
-    MeshRef.normals = static_cast<float*>(MemAlloc(sizeof(float) * 3 * MeshRef.vertexCount));
-    MeshRef.texcoords = static_cast<float*>(MemAlloc(sizeof(float) * 2 * MeshRef.vertexCount));
-    MeshRef.colors = nullptr;	// static_cast<unsigned char*>(MemAlloc(sizeof(unsigned char) * 4 * MeshRef.vertexCount));
+    // the pooled block comes back zeroed, with the arrays for the format pointed into it
+    Output = MeshBuffer(faces * (Indexed ? 4 : 6), Format == VertexFormat::Packed);
 
-    MeshRef.animNormals = nullptr;
-    MeshRef.animVertices = nullptr;
-    MeshRef.boneIds = nullptr;
-    MeshRef.boneWeights = nullptr;
-    MeshRef.tangents = nullptr;
-    MeshRef.indices = nullptr;
-    MeshRef.texcoords2 = nullptr;
-}
+    Mesh& mesh = Output.GetMesh();
+    mesh.triangleCount = faces * 2;
+    mesh.indices = Indexed && !Output.IsEmpty() ? const_cast<unsigned short*>(GetQuadIndices()) : nullptr;
 
-void CubeGeometryBuilder::SetNormal(Vector3& value) 
-{ 
-    Normal = value;
+    MeshRef = mesh;
+    VertexIndex = 0;
 }
 
-void CubeGeometryBuilder::SetNormal(float x, float y, float z)
-{ 
-    Normal = Vector3{ x,y,z }; 
-}
-
-void CubeGeometryBuilder::SetSetUV(Vector2& value)
-{ 
-    UV = value;
-}
+void CubeGeometryBuilder::Begin()
+{
+    Output.Release();
+    MeshRef = Mesh{ 0 };
+    Growing = true;
+    Indexed = true;
+    VertexIndex = 0;
 
-void CubeGeometryBuilder::SetSetUV(float x, float y) 
-{ 
-    UV = Vector2{ x,y }; 
+    Reserve(0);
 }
 
-void CubeGeometryBuilder::PushVertex(Vector3& vertex, float xOffset, float yOffset, float zOffset)
+void CubeGeometryBuilder::Reserve(size_t vertices)
 {
-    size_t index = 0;
+    if (!Growing)
+        return;
 
-    if (MeshRef.colors != nullptr)
+    if (Format == VertexFormat::Packed)
     {
-        index = TriangleIndex * 12 + VertIndex * 4;
-        MeshRef.colors[index] = VertColor.r;
-        MeshRef.colors[index + 1] = VertColor.g;
-        MeshRef.colors[index + 2] = VertColor.b;
-        MeshRef.colors[index + 3] = VertColor.a;
+        if (vertices > Scratch.Packed.size() / PackedVertexSize || Scratch.Packed.empty())
+            Scratch.Packed.resize(std::max({ vertices, Scratch.Packed.size() / PackedVertexSize * 2, size_t(1024) }) * PackedVertexSize);
+
+        MeshRef.colors = Scratch.Packed.data();
+        return;
     }
 
-    if (MeshRef.texcoords != nullptr)
+    if (vertices > Scratch.Vertices.size() / 3 || Scratch.Vertices.empty())
     {
-        index = TriangleIndex * 6 + VertIndex * 2;
-        MeshRef.texcoords[index] = UV.x;
-        MeshRef.texcoords[index + 1] = UV.y;
+        size_t capacity = std::max({ vertices, Scratch.Vertices.size() / 3 * 2, size_t(1024) });
+        Scratch.Vertices.resize(capacity * 3);
+        Scratch.Normals.resize(capacity * 3);
+        Scratch.TexCoords.resize(capacity * 2);
+        Scratch.TexCoords2.resize(capacity * 2);
     }
 
-    if (MeshRef.normals != nullptr)
+    MeshRef.vertices = Scratch.Vertices.data();
+    MeshRef.normals = Scratch.Normals.data();
+    MeshRef.texcoords = Scratch.TexCoords.data();
+    MeshRef.texcoords2 = Scratch.TexCoords2.data();
+}
+
+void CubeGeometryBuilder::Finish(int spareFaces)
+{
+    if (!Growing)
+        return;
+
+    Growing = false;
+
+    int faces = int(VertexIndex / 4);
+    Allocate(faces + spareFaces);
+
+    // the scratch always holds 4 corners a face, meshes too big for the shared indices get the 6 vertex triangle order
+    auto copy = [this, faces](const auto* source, auto* dest, size_t components)
+        {
+            if (Indexed)
+            {
+                std::copy(source, source + faces * 4 * components, dest);
+                return;
+            }
+
+            for (int face = 0; face < faces; face++)
+            {
+                for (int corner : TriangleOrder)
+                    dest = std::copy(source + (face * 4 + corner) * components, source + (face * 4 + corner + 1) * components, dest);
+            }
+        };
+
+    if (Format == VertexFormat::Packed)
     {
-        index = TriangleIndex * 9 + VertIndex * 3;
-        MeshRef.normals[index] = Normal.x;
-        MeshRef.normals[index + 1] = Normal.y;
-        MeshRef.normals[index + 2] = Normal.z;
+        copy(Scratch.Packed.data(), MeshRef.colors, PackedVertexSize);
+    }
+    else
+    {
+        copy(Scratch.Vertices.data(), MeshRef.vertices, 3);
+        copy(Scratch.Normals.data(), MeshRef.normals, 3);
+        copy(Scratch.TexCoords.data(), MeshRef.texcoords, 2);
+        copy(Scratch.TexCoords2.data(), MeshRef.texcoords2, 2);
     }
 
-    index = TriangleIndex * 9 + VertIndex * 3;
-    MeshRef.vertices[index] = vertex.x + xOffset;
-    MeshRef.vertices[index + 1] = vertex.y + yOffset;
-    MeshRef.vertices[index + 2] = vertex.z + zOffset;
+    VertexIndex = size_t(faces) * (Indexed ? 4 : 6);
+}
 
-    VertIndex++;
-    if (VertIndex > 2)
+void CubeGeometryBuilder::SetFaceSlot(size_t slot)
+{
+    Indexed = MeshRef.indices != nullptr;
+    VertexIndex = slot * GetVertsPerFace(MeshRef);
+}
+
+void CubeGeometryBuilder::ClearFace(size_t slot)
+{
+    // collapse the quad to a point so it draws nothing
+    size_t verts = GetVertsPerFace(MeshRef);
+    if (Format == VertexFormat::Packed)
     {
-        TriangleIndex++;
-        VertIndex = 0;
+        std::fill(MeshRef.colors + slot * verts * PackedVertexSize, MeshRef.colors + (slot + 1) * verts * PackedVertexSize, (unsigned char)0);
+        return;
     }
+
+    std::fill(MeshRef.vertices + slot * verts * 3, MeshRef.vertices + (slot + 1) * verts * 3, 0.0f);
 }
 
 void CubeGeometryBuilder::AddCube(Vector3&& position, bool faces[6], Voxels::BlockType block)
 {
-    BlockInfo& uvInfo = BlockInfos[block];
-    SetSetUV(0, 0);
-    //z-
-    if (faces[NorthFace])
+    for (int face : FaceOrder)
     {
-        Rectangle& uvRect = uvInfo.FaceUVs[NorthFace];
+        if (faces[face])
+            AddFace(position, face, block);
+    }
+}
 
-        SetNormal(0, 0, -1);
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position);
+void CubeGeometryBuilder::AddFace(Vector3& position, int face, Voxels::BlockType block)
+{
+    AddQuad(position, face, block, Vector3{ 1, 1, 1 });
+}
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 0);
+struct CubeGeometryBuilder::FloatLayout
+{
+    // what every corner of a quad shares
+    struct QuadValues
+    {
+        const float* Normal;
+        float TileU;
+        float TileV;
+    };
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 0);
+    static QuadValues GetQuadValues(int face, Voxels::BlockType block)
+    {
+        const Rectangle& rect = BlockRegistry::GetFaceUVs(block)[face];
+        return QuadValues{ FaceNormals[face], rect.x, rect.y };
+    }
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position);
+    static void Write(const Mesh& mesh, size_t vertex, const QuadValues& quad, float x, float y, float z, float u, float v)
+    {
+        float* position = mesh.vertices + vertex * 3;
+        position[0] = x;
+        position[1] = y;
+        position[2] = z;
+
+        float* normal = mesh.normals + vertex * 3;
+        normal[0] = quad.Normal[0];
+        normal[1] = quad.Normal[1];
+        normal[2] = quad.Normal[2];
+
+        // every vertex gets the tile corner, the shader wraps the per block coordinates inside the tile
+        float* tile = mesh.texcoords + vertex * 2;
+        tile[0] = quad.TileU;
+        tile[1] = quad.TileV;
+
+        float* faceUV = mesh.texcoords2 + vertex * 2;
+        faceUV[0] = u;
+        faceUV[1] = v;
+    }
+};
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 0);
+struct CubeGeometryBuilder::PackedLayout
+{
+    struct QuadValues
+    {
+        unsigned char Face;
+        unsigned char TileX;
+        unsigned char TileY;
+    };
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 0);
+    static QuadValues GetQuadValues(int face, Voxels::BlockType block)
+    {
+        const AtlasTile& tile = BlockRegistry::GetFaceTiles(block)[face];
+        return QuadValues{ (unsigned char)face, tile.X, tile.Y };
     }
 
-    // z+
-    if (faces[SouthFace])
+    // positions are whole blocks inside the chunk, the normal comes from the face and the UVs from the tile
+    static void Write(const Mesh& mesh, size_t vertex, const QuadValues& quad, float x, float y, float z, float u, float v)
     {
-        Rectangle& uvRect = uvInfo.FaceUVs[SouthFace];
+        unsigned char* packed = mesh.colors + vertex * PackedVertexSize;
+        packed[0] = (unsigned char)x;
+        packed[1] = (unsigned char)y;
+        packed[2] = (unsigned char)z;
+        packed[3] = quad.Face;
+        packed[4] = quad.TileX;
+        packed[5] = quad.TileY;
+        packed[6] = (unsigned char)u;
+        packed[7] = (unsigned char)v;
+    }
+};
 
-        SetNormal(0, 0, 1);
+template <class Layout, int Count>
+void CubeGeometryBuilder::EmitQuad(const Vector3& position, int face, Voxels::BlockType block, const Vector3& size)
+{
+    // indexed meshes get the 4 corners, the rest repeat the shared diagonal to make two triangles
+    constexpr const int* order = Count == 4 ? IndexedOrder : TriangleOrder;
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 0, 0, 1);
+    // the texture repeats once per block along the two axes the face spans
+    const float sizes[3] = { size.x, size.y, size.z };
+    const float repeatU = sizes[FaceSpanAxes[face][0]];
+    const float repeatV = sizes[FaceSpanAxes[face][1]];
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 1);
+    const typename Layout::QuadValues quad = Layout::GetQuadValues(face, block);
+    const QuadCorner* corners = FaceCorners[face];
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 1);
+    Reserve(VertexIndex + Count);
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 0, 0, 1);
+    for (int i = 0; i < Count; i++)
+    {
+        const QuadCorner& corner = corners[order[i]];
+        Layout::Write(MeshRef, VertexIndex + i, quad,
+            position.x + corner.X * size.x, position.y + corner.Y * size.y, position.z + corner.Z * size.z,
+            corner.MaxU ? repeatU : 0.0f, corner.MaxV ? repeatV : 0.0f);
+    }
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 1);
+    VertexIndex += Count;
+}
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 1);
+void CubeGeometryBuilder::AddQuad(Vector3& position, int face, Voxels::BlockType block, const Vector3& size)
+{
+    // the layout and the corner count are picked once a quad, each pair is its own branch free copy of EmitQuad
+    if (Format == VertexFormat::Packed)
+    {
+        if (Indexed)
+            EmitQuad<PackedLayout, 4>(position, face, block, size);
+        else
+            EmitQuad<PackedLayout, 6>(position, face, block, size);
+    }
+    else
+    {
+        if (Indexed)
+            EmitQuad<FloatLayout, 4>(position, face, block, size);
+        else
+            EmitQuad<FloatLayout, 6>(position, face, block, size);
     }
+}
+
+const unsigned short* CubeGeometryBuilder::GetQuadIndices()
+{
+    // the same two triangles for every quad, built once and shared by every chunk mesh
+    static const std::vector<unsigned short> indices = []()
+        {
+            std::vector<unsigned short> quadIndices(MaxIndexedQuads * 6);
+            for (int quad = 0; quad < MaxIndexedQuads; quad++)
+            {
+                unsigned short first = (unsigned short)(quad * 4);
+                unsigned short* out = quadIndices.data() + quad * 6;
+                out[0] = first;
+                out[1] = first + 1;
+                out[2] = first + 2;
+                out[3] = first;
+                out[4] = first + 2;
+                out[5] = first + 3;
+            }
+            return quadIndices;
+        }();
+
+    return indices.data();
+}
 
-    // x+
-    if (faces[WestFace])
+Mesh CubeGeometryBuilder::Upload(MeshBuffer&& buffer)
+{
+    // the buffer goes back to the pool when this returns, nothing reads the CPU arrays after the upload
+    MeshBuffer uploading = std::move(buffer);
+    Mesh mesh = uploading.GetMesh();
+
+    // chunks with nothing to draw don't need a vertex array
+    if (uploading.IsEmpty())
+        return Mesh{ 0 };
+
+    bool indexed = mesh.indices != nullptr;
+    if (indexed && SharedIndexBuffer == 0)
+        SharedIndexBuffer = rlLoadVertexBufferElement(GetQuadIndices(), MaxIndexedQuads * 6 * sizeof(unsigned short), false);
+
+    if (!IsPacked(mesh))
     {
-        Rectangle& uvRect = uvInfo.FaceUVs[WestFace];
+        // hide the shared indices from raylib so it does not make a private copy of them
+        unsigned short* indices = mesh.indices;
+        mesh.indices = nullptr;
+        UploadMesh(&mesh, false);
+        mesh.indices = indices;
+
+        if (indexed)
+        {
+            rlEnableVertexArray(mesh.vaoId);
+            rlEnableVertexBufferElement(SharedIndexBuffer);
+            rlDisableVertexArray();
+        }
+        return DropVertexArrays(mesh);
+    }
 
-        SetNormal(1, 0, 0);
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 1);
+    // UnloadMesh walks raylib's full list of vertex buffers, so leave room for all of them
+    constexpr int vertexBufferSlots = 16;
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 1, 0, 0);
+    mesh.vaoId = rlLoadVertexArray();
+    rlEnableVertexArray(mesh.vaoId);
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 1, 1, 0);
+    mesh.vboId = static_cast<unsigned int*>(MemAlloc(sizeof(unsigned int) * vertexBufferSlots));
+    mesh.vboId[0] = rlLoadVertexBuffer(mesh.colors, mesh.vertexCount * PackedVertexSize, false);
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 1);
+    // both words are read as unnormalized bytes, so the shader sees the exact integer values
+    rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 4, RL_UNSIGNED_BYTE, false, PackedVertexSize, 0);
+    rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+    rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, 4, RL_UNSIGNED_BYTE, false, PackedVertexSize, 4);
+    rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR);
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 1, 1, 0);
+    if (indexed)
+        rlEnableVertexBufferElement(SharedIndexBuffer);
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 1);
-    }
+    rlDisableVertexArray();
 
-    // x-
-    if (faces[EastFace])
-    {
-        Rectangle& uvRect = uvInfo.FaceUVs[EastFace];
+    return DropVertexArrays(mesh);
+}
 
-        SetNormal(-1, 0, 0);
+uint8_t CubeGeometryBuilder::GetFacesToward(const Vector3& point, const Vector3& boxMin, const Vector3& boxMax)
+{
+    const float pointAxes[3] = { point.x, point.y, point.z };
+    const float minAxes[3] = { boxMin.x, boxMin.y, boxMin.z };
+    const float maxAxes[3] = { boxMax.x, boxMax.y, boxMax.z };
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 0, 0, 1);
+    // a face can be seen when the point is on its front side of at least one plane in the box it could be on
+    uint8_t faces = 0;
+    for (int face = 0; face < 6; face++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float normal = FaceNormals[face][axis];
+            if ((normal > 0 && pointAxes[axis] > minAxes[axis]) || (normal < 0 && pointAxes[axis] < maxAxes[axis]))
+                faces |= uint8_t(1 << face);
+        }
+    }
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 0);
+    return faces;
+}
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 0, 0, 0);
+int CubeGeometryBuilder::DrawFaces(const Mesh& mesh, const MeshFaceRanges& ranges, uint8_t faceMask, const Material& material, const Matrix& transform)
+{
+    // the same shader setup as DrawMesh, done once for all the ranges
+    // raylib only ever allocates the maps up to MATERIAL_MAP_BRDF
+    constexpr int materialMapCount = MATERIAL_MAP_BRDF + 1;
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 0, 0, 1);
+    // empty meshes were never uploaded
+    if (mesh.vaoId == 0)
+        return 0;
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 0, 1, 1);
+    rlEnableShader(material.shader.id);
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 0);
+    if (material.shader.locs[SHADER_LOC_COLOR_DIFFUSE] != -1)
+    {
+        Vector4 color = ColorNormalize(material.maps[MATERIAL_MAP_DIFFUSE].color);
+        rlSetUniform(material.shader.locs[SHADER_LOC_COLOR_DIFFUSE], &color, SHADER_UNIFORM_VEC4, 1);
     }
 
-    if (faces[UpFace])
+    if (material.shader.locs[SHADER_LOC_COLOR_SPECULAR] != -1)
     {
-        Rectangle& uvRect = uvInfo.FaceUVs[UpFace];
+        Vector4 color = ColorNormalize(material.maps[MATERIAL_MAP_SPECULAR].color);
+        rlSetUniform(material.shader.locs[SHADER_LOC_COLOR_SPECULAR], &color, SHADER_UNIFORM_VEC4, 1);
+    }
 
-        SetNormal(0, 1, 0);
+    Matrix matView = rlGetMatrixModelview();
+    Matrix matProjection = rlGetMatrixProjection();
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 0);
+    if (material.shader.locs[SHADER_LOC_MATRIX_VIEW] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_VIEW], matView);
+    if (material.shader.locs[SHADER_LOC_MATRIX_PROJECTION] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_PROJECTION], matProjection);
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 1, 1);
+    Matrix matModel = MatrixMultiply(transform, rlGetMatrixTransform());
+    if (material.shader.locs[SHADER_LOC_MATRIX_MODEL] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_MODEL], matModel);
+    if (material.shader.locs[SHADER_LOC_MATRIX_NORMAL] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_NORMAL], MatrixTranspose(MatrixInvert(matModel)));
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 1, 0);
+    rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_MVP], MatrixMultiply(MatrixMultiply(matModel, matView), matProjection));
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 1, 0);
+    auto isCubemap = [](int map) { return map == MATERIAL_MAP_IRRADIANCE || map == MATERIAL_MAP_PREFILTER || map == MATERIAL_MAP_CUBEMAP; };
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 0, 1, 1);
+    for (int map = 0; map < materialMapCount; map++)
+    {
+        if (material.maps[map].texture.id == 0)
+            continue;
+
+        rlActiveTextureSlot(map);
+        if (isCubemap(map))
+            rlEnableTextureCubemap(material.maps[map].texture.id);
+        else
+            rlEnableTexture(material.maps[map].texture.id);
+        rlSetUniform(material.shader.locs[SHADER_LOC_MAP_DIFFUSE + map], &map, SHADER_UNIFORM_INT, 1);
+    }
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 1, 1);
+    // chunk meshes are always uploaded with a vertex array
+    rlEnableVertexArray(mesh.vaoId);
+
+    int vertsPerFace = GetVertsPerFace(mesh);
+    int triangles = 0;
+
+    auto drawQuads = [&](uint32_t first, uint32_t count)
+        {
+            if (count == 0)
+                return;
+
+            // both layouts take 6 indices or vertices a quad, the shared indices for quad n start at n * 6
+            if (mesh.indices != nullptr)
+                rlDrawVertexArrayElements(int(first) * 6, int(count) * 6, nullptr);
+            else
+                rlDrawVertexArray(int(first) * vertsPerFace, int(count) * vertsPerFace);
+
+            triangles += int(count) * 2;
+        };
+
+    // ranges are stored back to back, so neighbors that are both drawn go out as one call
+    uint32_t runFirst = 0;
+    uint32_t runCount = 0;
+    for (int range = 0; range < MeshFaceRanges::RangeCount; range++)
+    {
+        bool draw = range == MeshFaceRanges::AnyFace || (faceMask & (1 << range)) != 0;
+        if (!draw || ranges.Count[range] == 0)
+            continue;
+
+        if (runCount > 0 && runFirst + runCount == ranges.First[range])
+        {
+            runCount += ranges.Count[range];
+            continue;
+        }
+
+        drawQuads(runFirst, runCount);
+        runFirst = ranges.First[range];
+        runCount = ranges.Count[range];
     }
+    drawQuads(runFirst, runCount);
 
-    SetSetUV(0, 0);
-    if (faces[DownFace])
+    for (int map = 0; map < materialMapCount; map++)
     {
-        Rectangle& uvRect = uvInfo.FaceUVs[DownFace];
+        if (material.maps[map].texture.id == 0)
+            continue;
+
+        rlActiveTextureSlot(map);
+        if (isCubemap(map))
+            rlDisableTextureCubemap();
+        else
+            rlDisableTexture();
+    }
 
-        SetNormal(0, -1, 0);
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+    rlDisableShader();
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 0, 0);
+    rlSetMatrixModelview(matView);
+    rlSetMatrixProjection(matProjection);
 
-        SetSetUV(uvRect.width, uvRect.y);
-        PushVertex(position, 1, 0, 0);
+    return triangles;
+}
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 1);
+void CubeGeometryBuilder::Unload(Mesh& mesh)
+{
+    if (mesh.vaoId == 0)
+    {
+        mesh = Mesh{ 0 };
+        return;
+    }
 
-        SetSetUV(uvRect.x, uvRect.y);
-        PushVertex(position, 0, 0, 0);
+    // the indices belong to every mesh, UnloadMesh would free them
+    mesh.indices = nullptr;
+    UnloadMesh(mesh);
+    mesh = Mesh{ 0 };
+}
 
-        SetSetUV(uvRect.width, uvRect.height);
-        PushVertex(position, 1, 0, 1);
+void CubeGeometryBuilder::UnloadSharedBuffers()
+{
+    if (SharedIndexBuffer != 0)
+        rlUnloadVertexBuffer(SharedIndexBuffer);
+    SharedIndexBuffer = 0;
+}
+
+void CubeGeometryBuilder::UpdateFaces(Mesh& mesh, const Mesh& faces, size_t firstSlot, size_t count)
+{
+    int vertsPerFace = GetVertsPerFace(mesh);
+    int first = int(firstSlot) * vertsPerFace;
+    int verts = int(count) * vertsPerFace;
 
-        SetSetUV(uvRect.x, uvRect.height);
-        PushVertex(position, 0, 0, 1);
+    if (IsPacked(mesh))
+    {
+        UpdateMeshBuffer(mesh, 0, faces.colors, verts * PackedVertexSize, first * PackedVertexSize);
+        return;
     }
+
+    UpdateMeshBuffer(mesh, 0, faces.vertices, verts * 3 * sizeof(float), first * 3 * sizeof(float));
+    UpdateMeshBuffer(mesh, 1, faces.texcoords, verts * 2 * sizeof(float), first * 2 * sizeof(float));
+    UpdateMeshBuffer(mesh, 2, faces.normals, verts * 3 * sizeof(float), first * 3 * sizeof(float));
+    UpdateMeshBuffer(mesh, 5, faces.texcoords2, verts * 2 * sizeof(float), first * 2 * sizeof(float));
+}
+
+Mesh CubeGeometryBuilder::DropVertexArrays(Mesh mesh)
+{
+    // the arrays belong to the pooled buffer, the GPU mesh keeps only its handles, counts and the shared indices
+    mesh.vertices = nullptr;
+    mesh.normals = nullptr;
+    mesh.texcoords = nullptr;
+    mesh.texcoords2 = nullptr;
+    mesh.colors = nullptr;
+    return mesh;
 }
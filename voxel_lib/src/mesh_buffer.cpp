@@ -0,0 +1,155 @@
+#include "mesh_buffer.h"
+
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Voxels
+{
+    namespace
+    {
+        // blocks are powers of two from 16k up, bigger meshes get an exact size block that is freed on release
+        constexpr size_t MinBlockSize = 16 * 1024;
+        constexpr int SizeClassCount = 12;
+
+        // free blocks kept for each size class, anything past this is freed
+        constexpr size_t MaxFreeBlocks = 32;
+
+        struct BlockPool
+        {
+            std::mutex Lock;
+            std::vector<void*> FreeBlocks[SizeClassCount];
+            size_t FreeBytes = 0;
+        };
+
+        // meshes are released by workers and the main thread, and chunks can outlive statics at shutdown
+        // so the pool is never destroyed
+        BlockPool& GetPool()
+        {
+            static BlockPool* pool = new BlockPool();
+            return *pool;
+        }
+
+        int GetSizeClass(size_t bytes)
+        {
+            size_t blockSize = MinBlockSize;
+            for (int sizeClass = 0; sizeClass < SizeClassCount; sizeClass++, blockSize *= 2)
+            {
+                if (bytes <= blockSize)
+                    return sizeClass;
+            }
+            return -1;
+        }
+
+        size_t GetClassSize(int sizeClass)
+        {
+            return MinBlockSize << sizeClass;
+        }
+    }
+
+    MeshBuffer::MeshBuffer(int vertexCount, bool packed)
+        : Packed(packed)
+    {
+        if (vertexCount <= 0)
+            return;
+
+        size_t bytes = size_t(vertexCount) * (packed ? PackedVertexSize : FloatVertexSize);
+        SizeClass = GetSizeClass(bytes);
+
+        if (SizeClass >= 0)
+        {
+            BlockPool& pool = GetPool();
+            {
+                std::lock_guard guard(pool.Lock);
+                std::vector<void*>& freeBlocks = pool.FreeBlocks[SizeClass];
+                if (!freeBlocks.empty())
+                {
+                    Block = freeBlocks.back();
+                    freeBlocks.pop_back();
+                    pool.FreeBytes -= GetClassSize(SizeClass);
+                }
+            }
+
+            // reused blocks are zeroed like new ones, so faces that are never written draw nothing
+            if (Block)
+                memset(Block, 0, bytes);
+            else
+                Block = MemAlloc((unsigned int)GetClassSize(SizeClass));
+        }
+        else
+        {
+            Block = MemAlloc((unsigned int)bytes);
+        }
+
+        View.vertexCount = vertexCount;
+
+        if (packed)
+        {
+            View.colors = static_cast<unsigned char*>(Block);
+            return;
+        }
+
+        float* floats = static_cast<float*>(Block);
+        View.vertices = floats;
+        View.normals = View.vertices + vertexCount * 3;
+        View.texcoords = View.normals + vertexCount * 3;
+        View.texcoords2 = View.texcoords + vertexCount * 2;
+    }
+
+    MeshBuffer::MeshBuffer(MeshBuffer&& other) noexcept
+        : Block(std::exchange(other.Block, nullptr))
+        , SizeClass(std::exchange(other.SizeClass, -1))
+        , Packed(std::exchange(other.Packed, false))
+        , View(std::exchange(other.View, Mesh{ 0 }))
+        , FaceRanges(std::exchange(other.FaceRanges, MeshFaceRanges()))
+    {
+    }
+
+    MeshBuffer& MeshBuffer::operator=(MeshBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            Block = std::exchange(other.Block, nullptr);
+            SizeClass = std::exchange(other.SizeClass, -1);
+            Packed = std::exchange(other.Packed, false);
+            View = std::exchange(other.View, Mesh{ 0 });
+            FaceRanges = std::exchange(other.FaceRanges, MeshFaceRanges());
+        }
+        return *this;
+    }
+
+    void MeshBuffer::Release()
+    {
+        bool pooled = false;
+        if (Block && SizeClass >= 0)
+        {
+            BlockPool& pool = GetPool();
+            std::lock_guard guard(pool.Lock);
+            std::vector<void*>& freeBlocks = pool.FreeBlocks[SizeClass];
+            if (freeBlocks.size() < MaxFreeBlocks)
+            {
+                freeBlocks.push_back(Block);
+                pool.FreeBytes += GetClassSize(SizeClass);
+                pooled = true;
+            }
+        }
+
+        if (Block && !pooled)
+            MemFree(Block);
+
+        Block = nullptr;
+        SizeClass = -1;
+        Packed = false;
+        View = Mesh{ 0 };
+        FaceRanges = MeshFaceRanges();
+    }
+
+    size_t MeshBuffer::GetPooledBytes()
+    {
+        BlockPool& pool = GetPool();
+        std::lock_guard guard(pool.Lock);
+        return pool.FreeBytes;
+    }
+}
@@ -19,6 +19,12 @@ namespace Tasks
         ThreadPool->detach_task([task]() {task(); });
         return true;
     }
+
+    void WaitForTasks()
+    {
+        if (ThreadPool)
+            ThreadPool->wait();
+    }
     
     void Shutdown()
     {
@@ -1,166 +1,1439 @@
 #include "voxel_lib.h"
 
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <thread>
+
 namespace Voxels
 {
-    std::unordered_map<BlockType, BlockInfo> BlockInfos;
+    namespace
+    {
+        // held for a handful of instructions by block writers and by readers copying section pointers
+        class SectionLockGuard
+        {
+        public:
+            explicit SectionLockGuard(std::atomic_flag& flag)
+                : Flag(flag)
+            {
+                while (Flag.test_and_set(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+
+            ~SectionLockGuard()
+            {
+                Flag.clear(std::memory_order_release);
+            }
+
+        private:
+            std::atomic_flag& Flag;
+        };
+
+        // sections a writer replaced can still be in use by readers that don't take the section lock
+        // each reading thread announces the epoch it started in, replaced sections are retired with the epoch
+        // they were replaced in and freed once every reader has announced a later one
+        class SectionReclaimer
+        {
+        public:
+            static SectionReclaimer& Get()
+            {
+                static SectionReclaimer reclaimer;
+                return reclaimer;
+            }
+
+            // returns the reader slot for the thread to use, NoSlot if they are all taken
+            int ClaimSlot()
+            {
+                for (int slot = 0; slot < MaxReaders; slot++)
+                {
+                    bool claimed = false;
+                    if (Readers[slot].Claimed.compare_exchange_strong(claimed, true, std::memory_order_acq_rel))
+                        return slot;
+                }
+                return NoSlot;
+            }
+
+            void ReleaseSlot(int slot)
+            {
+                if (slot != NoSlot)
+                    Readers[slot].Claimed.store(false, std::memory_order_release);
+            }
+
+            void Enter(int slot)
+            {
+                // threads without a slot are counted, nothing is freed while any of them are reading
+                if (slot == NoSlot)
+                    OverflowReaders.fetch_add(1, std::memory_order_seq_cst);
+                else
+                    Readers[slot].Epoch.store(Epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+
+            void Leave(int slot)
+            {
+                if (slot == NoSlot)
+                    OverflowReaders.fetch_sub(1, std::memory_order_seq_cst);
+                else
+                    Readers[slot].Epoch.store(0, std::memory_order_release);
+            }
+
+            // the section must not be published any more
+            void Retire(std::shared_ptr<ChunkSection> section)
+            {
+                uint64_t epoch = Epoch.fetch_add(1, std::memory_order_seq_cst);
+
+                std::lock_guard<std::mutex> lock(RetiredLock);
+                Retired.push_back(RetiredSection{ epoch, std::move(section) });
+
+                // scanning the readers costs more than holding a few sections a little longer
+                if (Retired.size() >= CollectSize)
+                    Collect();
+            }
+
+            static constexpr int NoSlot = -1;
+
+        private:
+            static constexpr int MaxReaders = 64;
+            static constexpr size_t CollectSize = 64;
+
+            struct alignas(64) ReaderSlot
+            {
+                // 0 while the thread is not reading
+                std::atomic<uint64_t> Epoch = 0;
+                std::atomic<bool> Claimed = false;
+            };
+
+            struct RetiredSection
+            {
+                uint64_t Epoch = 0;
+                std::shared_ptr<ChunkSection> Section;
+            };
+
+            std::atomic<uint64_t> Epoch = 1;
+            ReaderSlot Readers[MaxReaders];
+            std::atomic<int> OverflowReaders = 0;
+
+            std::mutex RetiredLock;
+            std::vector<RetiredSection> Retired;
+
+            void Collect()
+            {
+                if (OverflowReaders.load(std::memory_order_seq_cst) != 0)
+                    return;
+
+                // a reader that started in some epoch may hold anything retired in that epoch or later
+                uint64_t oldestReader = std::numeric_limits<uint64_t>::max();
+                for (auto& reader : Readers)
+                {
+                    uint64_t epoch = reader.Epoch.load(std::memory_order_seq_cst);
+                    if (epoch != 0)
+                        oldestReader = std::min(oldestReader, epoch);
+                }
+
+                Retired.erase(std::remove_if(Retired.begin(), Retired.end(), [oldestReader](const RetiredSection& retired) { return retired.Epoch < oldestReader; }), Retired.end());
+            }
+        };
+
+        // held while reading a published section, nested guards on one thread share the outer one
+        class SectionReadGuard
+        {
+        public:
+            SectionReadGuard()
+            {
+                ThreadReader& reader = GetThreadReader();
+                if (reader.Depth++ == 0)
+                    SectionReclaimer::Get().Enter(reader.Slot);
+            }
+
+            ~SectionReadGuard()
+            {
+                ThreadReader& reader = GetThreadReader();
+                if (--reader.Depth == 0)
+                    SectionReclaimer::Get().Leave(reader.Slot);
+            }
+
+        private:
+            struct ThreadReader
+            {
+                int Slot = SectionReclaimer::Get().ClaimSlot();
+                int Depth = 0;
+
+                ~ThreadReader() { SectionReclaimer::Get().ReleaseSlot(Slot); }
+            };
+
+            static ThreadReader& GetThreadReader()
+            {
+                static thread_local ThreadReader reader;
+                return reader;
+            }
+        };
+
+        BlockType GetSectionVoxel(const ChunkSection& section, int h, int v, int d)
+        {
+            if (section.IsUniform())
+                return section.GetUniformBlock();
+
+            return section.Blocks.Get(Chunk::SectionLayout::GetIndex(h, v, d % Chunk::SectionHeight));
+        }
+
+        // distance between neighboring blocks along h in a section, or 0 if the layout does not keep rows evenly spaced
+        constexpr int GetRowStride()
+        {
+            using Layout = Chunk::SectionLayout;
+
+            int stride = Layout::GetIndex(1, 0, 0) - Layout::GetIndex(0, 0, 0);
+            for (int d = 0; d < Chunk::SectionHeight; d++)
+            {
+                for (int v = 0; v < Chunk::ChunkSize; v++)
+                {
+                    for (int h = 0; h < Chunk::ChunkSize; h++)
+                    {
+                        if (Layout::GetIndex(h, v, d) != Layout::GetIndex(0, v, d) + h * stride)
+                            return 0;
+                    }
+                }
+            }
+            return stride;
+        }
+
+        constexpr int RowStride = GetRowStride();
+    }
+
+    Chunk::Chunk()
+    {
+        for (int section = 0; section < SectionCount; section++)
+        {
+            Sections[section] = ChunkSection::GetUniform(EmptyBlock);
+            PublishedSections[section].store(Sections[section].get(), std::memory_order_relaxed);
+        }
+
+        ClearColumns();
+    }
+
+    BlockType Chunk::GetVoxel(int h, int v, int d)
+    {
+        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
+            return InvalidBlock;
+
+        SectionReadGuard guard;
+        return GetSectionVoxel(*PublishedSections[d / SectionHeight].load(std::memory_order_seq_cst), h, v, d);
+    }
+
+    int Chunk::GetTopBlockDepth(int h, int v)
+    {
+        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize)
+            return -1;
+
+        return GetTopSolidDepth(h, v);
+    }
+
+    void Chunk::RebuildColumns()
+    {
+        SectionLockGuard lock(SectionLock);
+
+        ColumnMask columns[ChunkSize * ChunkSize] = { 0 };
+
+        for (int section = 0; section < SectionCount; section++)
+        {
+            const ChunkSection& sectionData = *Sections[section];
+            int sectionBottom = section * SectionHeight;
+
+            // uniform sections set or skip the same bits in every column
+            if (sectionData.IsUniform())
+            {
+                if (!BlockRegistry::IsSolid(sectionData.GetUniformBlock()))
+                    continue;
+
+                ColumnMask bits = ColumnMask((FullColumn >> (ChunkHeight - SectionHeight)) << sectionBottom);
+                for (auto& column : columns)
+                    column |= bits;
+                continue;
+            }
+
+            for (int d = 0; d < SectionHeight; d++)
+            {
+                for (int v = 0; v < ChunkSize; v++)
+                {
+                    for (int h = 0; h < ChunkSize; h++)
+                    {
+                        if (BlockRegistry::IsSolid(sectionData.Blocks.Get(SectionLayout::GetIndex(h, v, d))))
+                            columns[GetColumnIndex(h, v)] |= ColumnMask(1) << (sectionBottom + d);
+                    }
+                }
+            }
+        }
+
+        for (int v = 0; v < ChunkSize; v++)
+        {
+            for (int h = 0; h < ChunkSize; h++)
+            {
+                int index = GetColumnIndex(h, v);
+                TopSolid[index].store(int16_t(columns[index] != 0 ? FindHighestBit(columns[index]) : -1), std::memory_order_relaxed);
+                TopOpaque[index].store(int16_t(FindTopBlock(h, v, ChunkHeight - 1, true)), std::memory_order_relaxed);
+                SolidColumns[index].store(columns[index], std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Chunk::ClearColumns()
+    {
+        for (int index = 0; index < ChunkSize * ChunkSize; index++)
+        {
+            TopSolid[index].store(-1, std::memory_order_relaxed);
+            TopOpaque[index].store(-1, std::memory_order_relaxed);
+            SolidColumns[index].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    int Chunk::FindTopBlock(int h, int v, int startD, bool opaque)
+    {
+        for (int section = startD / SectionHeight; section >= 0 && startD >= 0; section--)
+        {
+            int sectionBottom = section * SectionHeight;
+            const ChunkSection& sectionData = *Sections[section];
+
+            if (sectionData.IsUniform())
+            {
+                // the whole section is either a match or not, no need to look at each block
+                BlockType uniformBlock = sectionData.GetUniformBlock();
+                if (opaque ? BlockRegistry::IsOpaque(uniformBlock) : BlockRegistry::IsSolid(uniformBlock))
+                    return startD;
+
+                startD = sectionBottom - 1;
+                continue;
+            }
+
+            for (; startD >= sectionBottom; startD--)
+            {
+                BlockType block = sectionData.Blocks.Get(SectionLayout::GetIndex(h, v, startD - sectionBottom));
+                if (opaque ? BlockRegistry::IsOpaque(block) : BlockRegistry::IsSolid(block))
+                    return startD;
+            }
+        }
+
+        return -1;
+    }
+
+    std::shared_ptr<ChunkSection> Chunk::CopySection(int section) const
+    {
+        // a shared uniform section becomes real storage for this chunk
+        const ChunkSection& current = *Sections[section];
+        if (current.IsShared())
+            return std::make_shared<ChunkSection>(SectionBlockCount, current.GetUniformBlock());
+
+        return std::make_shared<ChunkSection>(current);
+    }
+
+    void Chunk::PublishSection(int section, std::shared_ptr<ChunkSection> sectionData)
+    {
+        // writes that leave a section all one type go back to the shared copy and free its storage
+        BlockType block = EmptyBlock;
+        if (!sectionData->IsShared() && sectionData->Blocks.IsSingleType(&block))
+            sectionData = ChunkSection::GetUniform(block);
+
+        PublishedSections[section].store(sectionData.get(), std::memory_order_seq_cst);
+        std::swap(Sections[section], sectionData);
+
+        // shared sections are never freed, anything else waits for readers that may still be in it
+        if (sectionData && !sectionData->IsShared())
+            SectionReclaimer::Get().Retire(std::move(sectionData));
+    }
+
+    void Chunk::SetVoxel(int h, int v, int d, BlockType block)
+    {
+        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
+            return;
+
+        {
+            SectionLockGuard lock(SectionLock);
+
+            int section = d / SectionHeight;
+            if (GetSectionVoxel(*Sections[section], h, v, d) == block)
+                return;
+
+            std::shared_ptr<ChunkSection> sectionData = CopySection(section);
+            sectionData->Blocks.Set(SectionLayout::GetIndex(h, v, d % SectionHeight), block);
+            PublishSection(section, std::move(sectionData));
+
+            UpdateColumn(h, v, d, block);
+            Version.fetch_add(1, std::memory_order_release);
+        }
+
+        MarkDirty();
+    }
+
+    void Chunk::SetRow(int h, int v, int d, int count, const BlockType* blocks)
+    {
+        if (v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
+            return;
+
+        // clip the row to the chunk
+        if (h < 0)
+        {
+            blocks -= h;
+            count += h;
+            h = 0;
+        }
+        count = std::min(count, ChunkSize - h);
+        if (count <= 0)
+            return;
+
+        int section = d / SectionHeight;
+        int sectionD = d % SectionHeight;
+
+        {
+            SectionLockGuard lock(SectionLock);
+
+            // nothing to write if the row is all holes, or only matches a shared section
+            const ChunkSection& current = *Sections[section];
+            BlockType sharedBlock = current.IsShared() ? current.GetUniformBlock() : InvalidBlock;
+            if (std::all_of(blocks, blocks + count, [sharedBlock](BlockType block) { return block == InvalidBlock || block == sharedBlock; }))
+                return;
+
+            std::shared_ptr<ChunkSection> sectionData = CopySection(section);
+            if (RowStride != 0)
+            {
+                sectionData->Blocks.SetRun(SectionLayout::GetIndex(h, v, sectionD), RowStride, count, blocks);
+            }
+            else
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    if (blocks[i] != InvalidBlock)
+                        sectionData->Blocks.Set(SectionLayout::GetIndex(h + i, v, sectionD), blocks[i]);
+                }
+            }
+
+            PublishSection(section, std::move(sectionData));
+
+            for (int i = 0; i < count; i++)
+            {
+                if (blocks[i] != InvalidBlock)
+                    UpdateColumn(h + i, v, d, blocks[i]);
+            }
+
+            Version.fetch_add(1, std::memory_order_release);
+        }
+
+        MarkDirty();
+    }
+
+    void Chunk::FillRow(int h, int v, int d, int count, BlockType block)
+    {
+        if (v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight || block == InvalidBlock)
+            return;
+
+        int start = std::max(h, 0);
+        int end = std::min(h + count, ChunkSize);
+        if (start >= end)
+            return;
+
+        {
+            SectionLockGuard lock(SectionLock);
+
+            const ChunkSection& current = *Sections[d / SectionHeight];
+            if (current.IsShared() && current.GetUniformBlock() == block)
+                return;
+
+            std::shared_ptr<ChunkSection> section = CopySection(d / SectionHeight);
+
+            int sectionD = d % SectionHeight;
+            if (RowStride != 0)
+            {
+                section->Blocks.FillRun(SectionLayout::GetIndex(start, v, sectionD), RowStride, end - start, block);
+            }
+            else
+            {
+                for (int i = start; i < end; i++)
+                    section->Blocks.Set(SectionLayout::GetIndex(i, v, sectionD), block);
+            }
+
+            PublishSection(d / SectionHeight, std::move(section));
+
+            // the block is the same all along the row, so look it up once
+            bool solid = BlockRegistry::IsSolid(block);
+            bool opaque = BlockRegistry::IsOpaque(block);
+            for (int i = start; i < end; i++)
+                UpdateColumn(i, v, d, solid, opaque);
+
+            Version.fetch_add(1, std::memory_order_release);
+        }
+
+        MarkDirty();
+    }
+
+    void Chunk::UpdateColumn(int h, int v, int d, BlockType block)
+    {
+        UpdateColumn(h, v, d, BlockRegistry::IsSolid(block), BlockRegistry::IsOpaque(block));
+    }
+
+    void Chunk::UpdateColumn(int h, int v, int d, bool solid, bool opaque)
+    {
+        // raising a column is a compare, lowering it takes the next solid bit from the mask or scans down from the old top
+        int index = GetColumnIndex(h, v);
+
+        ColumnMask column = SolidColumns[index].load(std::memory_order_relaxed);
+        int topSolid = TopSolid[index].load(std::memory_order_relaxed);
+        int topOpaque = TopOpaque[index].load(std::memory_order_relaxed);
+
+        if (solid)
+        {
+            column |= ColumnMask(1) << d;
+            topSolid = std::max(topSolid, d);
+        }
+        else
+        {
+            column &= ~(ColumnMask(1) << d);
+            if (d == topSolid)
+                topSolid = column != 0 ? FindHighestBit(column) : -1;
+        }
+
+        if (opaque)
+            topOpaque = std::max(topOpaque, d);
+        else if (d == topOpaque)
+            topOpaque = FindTopBlock(h, v, d - 1, true);
+
+        SolidColumns[index].store(column, std::memory_order_relaxed);
+        TopSolid[index].store(int16_t(topSolid), std::memory_order_relaxed);
+        TopOpaque[index].store(int16_t(topOpaque), std::memory_order_relaxed);
+    }
+
+    void Chunk::GetBlocks(BlockType* blocks) const
+    {
+        TakeSnapshot().GetBlocks(blocks);
+    }
+
+    void Chunk::SetBlocks(const BlockType* blocks)
+    {
+        SectionLockGuard lock(SectionLock);
+
+        for (int section = 0; section < SectionCount; section++)
+        {
+            const BlockType* sectionBlocks = blocks + section * SectionBlockCount;
+
+            // sections of a single type use the shared copy
+            if (std::all_of(sectionBlocks, sectionBlocks + SectionBlockCount, [sectionBlocks](BlockType block) { return block == sectionBlocks[0]; }))
+            {
+                PublishSection(section, ChunkSection::GetUniform(sectionBlocks[0]));
+                continue;
+            }
+
+            // every block is replaced, so there is nothing to copy
+            auto sectionData = std::make_shared<ChunkSection>(SectionBlockCount, EmptyBlock);
+            sectionData->Blocks.Encode(sectionBlocks);
+            PublishSection(section, std::move(sectionData));
+        }
+
+        // rebuild the height maps and column masks from the flat buffer while it is still hot
+        for (int v = 0; v < ChunkSize; v++)
+        {
+            for (int h = 0; h < ChunkSize; h++)
+            {
+                int topSolid = -1;
+                int topOpaque = -1;
+
+                ColumnMask column = 0;
+                for (int d = ChunkHeight - 1; d >= 0; d--)
+                {
+                    BlockType block = blocks[GetIndex(h, v, d)];
+                    if (topOpaque < 0 && BlockRegistry::IsOpaque(block))
+                        topOpaque = d;
+
+                    if (BlockRegistry::IsSolid(block))
+                    {
+                        column |= ColumnMask(1) << d;
+                        if (topSolid < 0)
+                            topSolid = d;
+                    }
+                }
+
+                int index = GetColumnIndex(h, v);
+                TopSolid[index].store(int16_t(topSolid), std::memory_order_relaxed);
+                TopOpaque[index].store(int16_t(topOpaque), std::memory_order_relaxed);
+                SolidColumns[index].store(column, std::memory_order_relaxed);
+            }
+        }
+
+        Version.fetch_add(1, std::memory_order_release);
+    }
+
+    ChunkSnapshot Chunk::TakeSnapshot() const
+    {
+        ChunkSnapshot snapshot;
+
+        SectionLockGuard lock(SectionLock);
+        snapshot.Version = Version.load(std::memory_order_acquire);
+        for (int section = 0; section < SectionCount; section++)
+            snapshot.Sections[section] = Sections[section];
+
+        for (int index = 0; index < ChunkSize * ChunkSize; index++)
+            snapshot.SolidColumns[index] = SolidColumns[index].load(std::memory_order_relaxed);
+
+        return snapshot;
+    }
+
+    uint32_t Chunk::GetVersion() const
+    {
+        return Version.load(std::memory_order_acquire);
+    }
+
+    size_t Chunk::GetMemoryUsage() const
+    {
+        size_t size = sizeof(Chunk);
+
+        SectionLockGuard lock(SectionLock);
+        for (auto& section : Sections)
+        {
+            if (!section->IsShared())
+                size += sizeof(ChunkSection) + section->Blocks.GetMemoryUsage() - sizeof(PalettedBlockStorage);
+        }
+        return size;
+    }
+
+    bool Chunk::SectionIsUniform(int section, BlockType* block) const
+    {
+        if (section < 0 || section >= SectionCount)
+            return false;
+
+        SectionReadGuard guard;
+        const ChunkSection& sectionData = *PublishedSections[section].load(std::memory_order_seq_cst);
+        if (!sectionData.IsUniform())
+            return false;
+
+        if (block)
+            *block = sectionData.GetUniformBlock();
+        return true;
+    }
+
+    bool Chunk::IsEmpty() const
+    {
+        for (int section = 0; section < SectionCount; section++)
+        {
+            BlockType block = EmptyBlock;
+            if (!SectionIsUniform(section, &block) || block != EmptyBlock)
+                return false;
+        }
+        return true;
+    }
+
+    void Chunk::Clear()
+    {
+        {
+            SectionLockGuard lock(SectionLock);
+
+            for (int section = 0; section < SectionCount; section++)
+                PublishSection(section, ChunkSection::GetUniform(EmptyBlock));
+
+            ClearColumns();
+        }
+
+        Version.fetch_add(1, std::memory_order_release);
+    }
+
+    void Chunk::TakeBlocks(Chunk& other)
+    {
+        {
+            SectionLockGuard lock(SectionLock);
+            SectionLockGuard otherLock(other.SectionLock);
+
+            // the other chunk keeps its sections published until it is cleared
+            for (int section = 0; section < SectionCount; section++)
+                PublishSection(section, other.Sections[section]);
+
+            for (int index = 0; index < ChunkSize * ChunkSize; index++)
+            {
+                TopSolid[index].store(other.TopSolid[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                TopOpaque[index].store(other.TopOpaque[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                SolidColumns[index].store(other.SolidColumns[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            Version.fetch_add(1, std::memory_order_release);
+        }
+
+        other.Clear();
+    }
+
+    BlockType ChunkSnapshot::GetVoxel(int h, int v, int d) const
+    {
+        if (h < 0 || h >= Chunk::ChunkSize || v < 0 || v >= Chunk::ChunkSize || d < 0 || d >= Chunk::ChunkHeight || !IsValid())
+            return InvalidBlock;
+
+        return GetSectionVoxel(*Sections[d / Chunk::SectionHeight], h, v, d);
+    }
+
+    void ChunkSnapshot::GetBlocks(BlockType* blocks) const
+    {
+        for (int section = 0; section < Chunk::SectionCount; section++)
+            Sections[section]->Blocks.Decode(blocks + section * Chunk::SectionBlockCount);
+    }
+
+    bool ChunkSnapshot::SectionIsUniform(int section, BlockType* block) const
+    {
+        if (section < 0 || section >= Chunk::SectionCount || !IsValid() || !Sections[section]->IsUniform())
+            return false;
+
+        if (block)
+            *block = Sections[section]->GetUniformBlock();
+        return true;
+    }
+
+    bool Chunk::BlockIsSolid(int h, int v, int d)
+    {
+        // blocks outside the chunk are invalid, and those are flagged as solid in the registry
+        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
+            return BlockRegistry::IsSolid(InvalidBlock);
+
+        // the column masks hold the same answer without reading the sections
+        return (GetSolidColumn(h, v) >> d) & 1;
+    }
+
+    Voxels::ChunkStatus Chunk::GetStatus() const
+    {
+        return ChunkStatus(State.load(std::memory_order_acquire) & StatusMask);
+    }
+
+    void Chunk::SetStatus(ChunkStatus status)
+    {
+        UpdateState(StatusMask, uint32_t(status));
+    }
+
+    bool Chunk::TryTransition(ChunkStatus from, ChunkStatus to)
+    {
+        uint32_t current = State.load(std::memory_order_acquire);
+        while (ChunkStatus(current & StatusMask) == from)
+        {
+            uint32_t desired = (current & ~StatusMask) | uint32_t(to);
+            if (State.compare_exchange_weak(current, desired, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    ChunkVisibilityRequirement Chunk::GetVisRequirement() const
+    {
+        return ChunkVisibilityRequirement((State.load(std::memory_order_acquire) & VisibilityMask) >> VisibilityShift);
+    }
+
+    void Chunk::SetVisRequirement(ChunkVisibilityRequirement status)
+    {
+        UpdateState(VisibilityMask, uint32_t(status) << VisibilityShift);
+    }
+
+    uint32_t Chunk::GetEpoch() const
+    {
+        return (State.load(std::memory_order_acquire) & EpochMask) >> EpochShift;
+    }
+
+    void Chunk::AdvanceEpoch()
+    {
+        uint32_t current = State.load(std::memory_order_acquire);
+        uint32_t desired = 0;
+        do
+        {
+            desired = (current & ~EpochMask) | ((current + (1u << EpochShift)) & EpochMask);
+        } while (!State.compare_exchange_weak(current, desired, std::memory_order_acq_rel, std::memory_order_acquire));
+    }
+
+    void Chunk::MarkDirty()
+    {
+        Dirty.fetch_add(2, std::memory_order_acq_rel);
+        Dirty.fetch_or(1, std::memory_order_acq_rel);
+    }
+
+    bool Chunk::IsDirty() const
+    {
+        return (Dirty.load(std::memory_order_acquire) & 1) != 0;
+    }
+
+    void Chunk::ClearDirty()
+    {
+        Dirty.fetch_and(~1u, std::memory_order_acq_rel);
+    }
+
+    uint32_t Chunk::GetDirtyCount() const
+    {
+        return Dirty.load(std::memory_order_acquire) >> 1;
+    }
+
+    bool Chunk::ClearDirty(uint32_t dirtyCount)
+    {
+        // a mark between the two steps of MarkDirty has already changed the count, so it is never lost
+        uint32_t current = Dirty.load(std::memory_order_acquire);
+        while ((current >> 1) == (dirtyCount & (~0u >> 1)))
+        {
+            if (Dirty.compare_exchange_weak(current, current & ~1u, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    // pins and slot changes are sequentially consistent, so either the pinning thread sees the
+    // chunk leave its slot or the evicting thread sees the pin
+    void Chunk::Pin()
+    {
+        Pins.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    void Chunk::Unpin()
+    {
+        Pins.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    bool Chunk::IsPinned() const
+    {
+        return Pins.load(std::memory_order_seq_cst) != 0;
+    }
 
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, bool solid)
+    ChunkHandle::ChunkHandle(ChunkHandle&& other) noexcept
+        : PinnedChunk(other.PinnedChunk)
     {
-        BlockInfo block;
-        for (int i = 0; i < 6; i++)
-            block.FaceUVs[i] = blockSides;
-        block.BlockID = blockId;
-        block.Solid = solid;
+        other.PinnedChunk = nullptr;
+    }
 
-        BlockInfos.insert_or_assign(blockId, block);
+    ChunkHandle::~ChunkHandle()
+    {
+        Reset();
     }
 
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, Rectangle& blockTop, bool solid)
+    ChunkHandle& ChunkHandle::operator=(ChunkHandle&& other) noexcept
     {
-        BlockInfo block;
-        for (int i = 0; i < 6; i++)
-            block.FaceUVs[i] = blockSides;
+        if (this != &other)
+        {
+            Reset();
+            PinnedChunk = other.PinnedChunk;
+            other.PinnedChunk = nullptr;
+        }
+        return *this;
+    }
 
-        block.FaceUVs[UpFace] = blockTop;
-        block.BlockID = blockId;
-        block.Solid = solid;
+    void ChunkHandle::Reset()
+    {
+        if (PinnedChunk)
+            PinnedChunk->Unpin();
 
-        BlockInfos.insert_or_assign(blockId, block);
+        PinnedChunk = nullptr;
     }
 
-    void SetBlockInfo(BlockType blockId, Rectangle& blockSides, Rectangle& blockTop, Rectangle& blockBottom, bool solid)
+    void Chunk::UpdateState(uint32_t mask, uint32_t value)
     {
-        BlockInfo block;
-        for (int i = 0; i < 6; i++)
-            block.FaceUVs[i] = blockSides;
-
-        block.FaceUVs[UpFace] = blockTop;
-        block.FaceUVs[DownFace] = blockBottom;
-        block.BlockID = blockId;
-        block.Solid = solid;
+        uint32_t current = State.load(std::memory_order_acquire);
+        while (!State.compare_exchange_weak(current, (current & ~mask) | value, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+        }
+    }
 
-        BlockInfos.insert_or_assign(blockId, block);
+    World::RegionTable::RegionTable(size_t capacity)
+        : Capacity(capacity)
+        , Slots(new std::atomic<ChunkRegion*>[capacity])
+    {
+        for (size_t i = 0; i < capacity; i++)
+            Slots[i].store(nullptr, std::memory_order_relaxed);
     }
 
-    BlockType Chunk::GetVoxel(int h, int v, int d)
+    Chunk World::SkyChunkMarker;
+    ChunkRegion World::RemovedRegionMarker;
+
+    // held by every lock free lookup while it uses a region table or region
+    // retired tables and regions are only freed while no guard is alive, and a guard made after something
+    // was retired can't reach it, so a reader never sees freed memory
+    struct World::RegionReadGuard
     {
-        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
-            return InvalidBlock;
+        explicit RegionReadGuard(const World& world)
+            : Readers(world.RegionReaders)
+        {
+            Readers.fetch_add(1, std::memory_order_seq_cst);
+        }
+
+        ~RegionReadGuard()
+        {
+            Readers.fetch_sub(1, std::memory_order_seq_cst);
+        }
 
-        return Blocks[(d * ChunkSize * ChunkSize) + (v * ChunkSize) + h];
+        std::atomic<int>& Readers;
+    };
+
+    World::World()
+    {
+        CurrentRegionTable = std::make_unique<RegionTable>(64);
+        Regions.store(CurrentRegionTable.get(), std::memory_order_release);
     }
 
-    int Chunk::GetTopBlockDepth(int h, int v)
+    World::~World()
+    {
+        // chunks belong to the pool and go away with its pages
+    }
+
+    Chunk& World::AddChunk(int32_t h, int32_t v, int32_t d)
     {
-        for (int d = ChunkHeight; d > 0; d--)
+        std::lock_guard <std::mutex> lock(ChunkLock);
+
+        std::atomic<Chunk*>& slot = GetOrAddSlot(h, v, d);
+
+        Chunk* chunk = slot.load(std::memory_order_relaxed);
+        if (!chunk || chunk == &SkyChunkMarker)
         {
-            if (BlockIsSolid(h, v, d-1))
-                return d-1;
+            chunk = Pool.Acquire();
+            chunk->Id = ChunkId(h, v, d);
+            TouchChunk(*chunk);
+
+            // publish the chunk after it is fully set up
+            slot.store(chunk, std::memory_order_release);
         }
 
-        return -1;
+        return *chunk;
     }
 
-    void Chunk::SetVoxel(int h, int v, int d, BlockType block)
+    Chunk& World::AddChunk(ChunkId id)
     {
-        if (h < 0 || h >= ChunkSize || v < 0 || v >= ChunkSize || d < 0 || d >= ChunkHeight)
+        return AddChunk(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
+    }
+
+    void World::RemoveChunk(ChunkId id)
+    {
+        std::lock_guard <std::mutex> lock(ChunkLock);
+
+        std::atomic<Chunk*>* slot = FindSlot(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
+        if (!slot)
             return;
 
-        Blocks[(d * ChunkSize * ChunkSize) + (v * ChunkSize) + h] = block;
+        Chunk* chunk = slot->exchange(nullptr, std::memory_order_acq_rel);
+        if (chunk && chunk != &SkyChunkMarker)
+        {
+            // anyone still holding the pointer will see the epoch change
+            chunk->AdvanceEpoch();
+            Pool.Release(chunk);
+        }
     }
 
-    bool Chunk::BlockIsSolid(int h, int v, int d)
+    void World::Reset()
     {
-        BlockType block = GetVoxel(h, v, d);
-        if (block == InvalidBlock)
-            return true;
+        std::lock_guard <std::mutex> lock(ChunkLock);
+
+        // unlink everything first, lookups that are still in the old table or regions keep them until they finish
+        RetiredRegionTables.push_back(std::move(CurrentRegionTable));
+        CurrentRegionTable = std::make_unique<RegionTable>(64);
+        Regions.store(CurrentRegionTable.get(), std::memory_order_seq_cst);
 
-        return BlockInfos[block].Solid;
+        for (auto& region : RegionStorage)
+            RetiredRegions.push_back(std::move(region));
+
+        RegionStorage.clear();
+        RegionCount = 0;
+        RemovedRegionCount = 0;
+
+        Pool.Reset();
+        FreeRetiredRegions();
     }
 
-    Voxels::ChunkStatus Chunk::GetStatus() const
+    Chunk* ChunkPool::Acquire()
     {
-        std::lock_guard<std::mutex> lock(StatusLock);
-        return Status;
+        Chunk* chunk = nullptr;
+
+        if (!FreeChunks.empty())
+        {
+            chunk = FreeChunks.back();
+            FreeChunks.pop_back();
+        }
+        else
+        {
+            if (NextPage == Pages.size())
+                Pages.push_back(std::make_unique<Chunk[]>(PageSize));
+
+            chunk = &Pages[NextPage][NextInPage];
+
+            NextInPage++;
+            if (NextInPage == PageSize)
+            {
+                NextPage++;
+                NextInPage = 0;
+            }
+        }
+
+        UsedCount++;
+
+        // the GPU mesh has to be unloaded by whoever drew the chunk before it leaves the world
+        // overwriting it here would leak its buffers
+        assert(chunk->ChunkMesh.vaoId == 0 && "chunk returned to the pool with its mesh still uploaded");
+
+        // reused chunks still hold whatever they had last time
+        chunk->Clear();
+        chunk->Id = ChunkId();
+        chunk->ChunkMeshFaces = MeshFaceRanges();
+        chunk->MeshFaces.reset();
+        chunk->MeshSpareFaces = 0;
+        chunk->MeshVersion = 0;
+        chunk->MeshLod = 0;
+        chunk->MeshBounds = BoundingBox{ 0 };
+        chunk->ClearDirty();
+        chunk->ClearModified();
+        chunk->Alpha = 0;
+        chunk->SetStatus(ChunkStatus::Empty);
+        chunk->SetVisRequirement(ChunkVisibilityRequirement::Unknown);
+        chunk->AdvanceEpoch();
+
+        return chunk;
     }
 
-    void Chunk::SetStatus(ChunkStatus status)
+    void ChunkPool::Release(Chunk* chunk)
     {
-        std::lock_guard<std::mutex> lock(StatusLock);
-        Status = status;
+        assert(chunk->ChunkMesh.vaoId == 0 && "chunk returned to the pool with its mesh still uploaded");
+
+        // nothing can be reading the blocks, the chunk is out of the world and not pinned
+        // snapshots hold their own references to the sections they use
+        chunk->Clear();
+        chunk->MeshFaces.reset();
+
+        FreeChunks.push_back(chunk);
+        UsedCount--;
     }
 
-    ChunkVisibilityRequirement Chunk::GetVisRequirement() const
+    void ChunkPool::Reset()
     {
-        std::lock_guard<std::mutex> lock(StatusLock);
-        return VisStatus;
+        // free chunks are visited too, it is cheaper than sorting them out
+        for (size_t page = 0; page < Pages.size() && page <= NextPage; page++)
+        {
+            size_t count = page < NextPage ? PageSize : NextInPage;
+            for (size_t i = 0; i < count; i++)
+            {
+                Chunk& chunk = Pages[page][i];
+                assert(!chunk.IsPinned() && "pool reset while a chunk is pinned");
+                assert(chunk.ChunkMesh.vaoId == 0 && "pool reset with a chunk mesh still uploaded");
+
+                // anyone still holding the pointer will see the epoch change
+                chunk.AdvanceEpoch();
+            }
+        }
+
+        FreeChunks.clear();
+        NextPage = 0;
+        NextInPage = 0;
+        UsedCount = 0;
     }
 
-    void Chunk::SetVisRequirement(ChunkVisibilityRequirement status)
+    Voxels::Chunk* World::GetChunk(int32_t h, int32_t v, int32_t d)
+    {
+        RegionReadGuard guard(*this);
+
+        std::atomic<Chunk*>* slot = FindSlot(h, v, d);
+        if (!slot)
+            return nullptr;
+
+        Chunk* chunk = slot->load(std::memory_order_acquire);
+        if (chunk == &SkyChunkMarker)
+            return nullptr;
+
+        return chunk;
+    }
+
+    Voxels::Chunk* World::GetChunk(ChunkId id)
     {
-        std::lock_guard<std::mutex> lock(StatusLock);
-        VisStatus = status;
+        return GetChunk(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
     }
 
-    Chunk& World::AddChunk(int32_t h, int32_t v)
+    ChunkHandle World::PinChunk(ChunkId id)
     {
-        ChunkId id;
-        id.Coordinate.h = h;
-        id.Coordinate.v = v;
+        RegionReadGuard guard(*this);
 
+        std::atomic<Chunk*>* slot = FindSlot(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
+        if (!slot)
+            return ChunkHandle();
+
+        while (true)
+        {
+            Chunk* chunk = slot->load(std::memory_order_seq_cst);
+            if (!chunk || chunk == &SkyChunkMarker)
+                return ChunkHandle();
+
+            // pin first, then make sure the chunk was not evicted before the pin landed
+            // pool memory is never freed, so pinning a chunk that was just reused is harmless
+            chunk->Pin();
+            if (slot->load(std::memory_order_seq_cst) == chunk)
+            {
+                TouchChunk(*chunk);
+                return ChunkHandle(chunk);
+            }
+
+            chunk->Unpin();
+        }
+    }
+
+    size_t World::EvictChunks(ChunkId center, std::function<bool(const Chunk&)> canEvict)
+    {
         std::lock_guard <std::mutex> lock(ChunkLock);
-        // todo, get the ref on insert
-        Chunks.try_emplace(id.Id).second;
-        Chunks[id.Id].Id = id;
-        return Chunks[id.Id];
+
+        FreeRetiredRegions();
+
+        if (MemoryBudget == 0)
+            return 0;
+
+        struct EvictionCandidate
+        {
+            std::atomic<Chunk*>* Slot = nullptr;
+            uint32_t Age = 0;
+            int64_t Distance = 0;
+            size_t Memory = 0;
+        };
+
+        // chunks are taller than they are wide, so vertical steps count for more
+        constexpr int64_t verticalScale = Chunk::ChunkHeight / Chunk::ChunkSize;
+
+        // chunks last used within this many ticks of each other count as used at the same time
+        constexpr uint32_t ageTicks = 60;
+        uint32_t tick = GetTick();
+
+        std::vector<EvictionCandidate> candidates;
+
+        // the chunk objects and regions stay allocated whatever is evicted, only block storage comes back
+        size_t memoryUsage = Pool.GetPageCount() * ChunkPool::PageSize * sizeof(Chunk) + RegionStorage.size() * sizeof(ChunkRegion);
+
+        for (auto& region : RegionStorage)
+        {
+            for (auto& slot : region->Chunks)
+            {
+                Chunk* chunk = slot.load(std::memory_order_relaxed);
+                if (!chunk || chunk == &SkyChunkMarker)
+                    continue;
+
+                size_t memory = chunk->GetMemoryUsage() - sizeof(Chunk);
+                memoryUsage += memory;
+
+                ChunkStatus status = chunk->GetStatus();
+                if (status != ChunkStatus::Generated && status != ChunkStatus::Populated)
+                    continue;
+
+                // it would be generated again without its edits
+                if (chunk->IsModified())
+                    continue;
+
+                if (canEvict && !canEvict(*chunk))
+                    continue;
+
+                int64_t h = chunk->Id.Coordinate.h - center.Coordinate.h;
+                int64_t v = chunk->Id.Coordinate.v - center.Coordinate.v;
+                int64_t d = (chunk->Id.Coordinate.d - center.Coordinate.d) * verticalScale;
+
+                // a worker can touch a chunk after the tick was read, that counts as just used
+                uint32_t lastTouched = chunk->GetLastTouched();
+                uint32_t age = lastTouched < tick ? (tick - lastTouched) / ageTicks : 0;
+                candidates.push_back(EvictionCandidate{ &slot, age, h * h + v * v + d * d, memory });
+            }
+        }
+
+        if (memoryUsage <= MemoryBudget)
+            return 0;
+
+        std::sort(candidates.begin(), candidates.end(), [](const EvictionCandidate& a, const EvictionCandidate& b)
+            {
+                if (a.Age != b.Age)
+                    return a.Age > b.Age;
+                return a.Distance > b.Distance;
+            });
+
+        size_t evicted = 0;
+        for (auto& candidate : candidates)
+        {
+            if (memoryUsage <= MemoryBudget)
+                break;
+
+            Chunk* chunk = candidate.Slot->load(std::memory_order_relaxed);
+            if (chunk->IsPinned())
+                continue;
+
+            // take it out of the map first, then check for a worker that pinned it in the meantime
+            candidate.Slot->exchange(nullptr, std::memory_order_seq_cst);
+            if (chunk->IsPinned())
+            {
+                candidate.Slot->store(chunk, std::memory_order_seq_cst);
+                continue;
+            }
+
+            chunk->AdvanceEpoch();
+            Pool.Release(chunk);
+
+            memoryUsage -= candidate.Memory;
+            evicted++;
+        }
+
+        if (evicted > 0)
+        {
+            RemoveEmptyRegions();
+            FreeRetiredRegions();
+        }
+
+        return evicted;
     }
 
-    Voxels::Chunk* World::GetChunk(int32_t h, int32_t v)
+    void World::RemoveEmptyRegions()
     {
-        ChunkId id;
-        id.Coordinate.h = h;
-        id.Coordinate.v = v;
-        return GetChunk(id);
+        RegionTable* table = Regions.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < RegionStorage.size();)
+        {
+            ChunkRegion* region = RegionStorage[i].get();
+
+            // sky markers are dropped with the region, the chunks are generated again if they are ever needed
+            bool empty = std::all_of(std::begin(region->Chunks), std::end(region->Chunks), [](const std::atomic<Chunk*>& slot)
+                {
+                    Chunk* chunk = slot.load(std::memory_order_relaxed);
+                    return chunk == nullptr || chunk == &SkyChunkMarker;
+                });
+
+            if (!empty)
+            {
+                i++;
+                continue;
+            }
+
+            size_t index = HashRegion(region->H, region->V, region->D, table->Capacity);
+            while (table->Slots[index].load(std::memory_order_relaxed) != region)
+                index = (index + 1) & (table->Capacity - 1);
+
+            table->Slots[index].store(&RemovedRegionMarker, std::memory_order_seq_cst);
+            RegionCount--;
+            RemovedRegionCount++;
+
+            RetiredRegions.push_back(std::move(RegionStorage[i]));
+            RegionStorage[i] = std::move(RegionStorage.back());
+            RegionStorage.pop_back();
+        }
     }
 
-    Voxels::Chunk* World::GetChunk(ChunkId id)
+    void World::FreeRetiredRegions()
+    {
+        if (RetiredRegions.empty() && RetiredRegionTables.empty())
+            return;
+
+        // everything was unlinked before this, so once no lookup is running none can be using them
+        if (RegionReaders.load(std::memory_order_seq_cst) != 0)
+            return;
+
+        RetiredRegions.clear();
+        RetiredRegionTables.clear();
+    }
+
+    void World::SetChunkLayers(int32_t minD, int32_t maxD)
+    {
+        MinChunkLayer = minD;
+        MaxChunkLayer = maxD;
+    }
+
+    void World::SetSkyChunk(ChunkId id)
     {
         std::lock_guard <std::mutex> lock(ChunkLock);
 
-        auto itr = Chunks.find(id.Id);
-        if (itr == Chunks.end())
-            return nullptr;
+        std::atomic<Chunk*>& slot = GetOrAddSlot(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
+
+        // a chunk that already has storage stays
+        if (slot.load(std::memory_order_relaxed) == nullptr)
+            slot.store(&SkyChunkMarker, std::memory_order_release);
+    }
+
+    bool World::IsSkyChunk(ChunkId id) const
+    {
+        if (id.Coordinate.d > MaxChunkLayer)
+            return true;
 
-        return &(itr->second);
+        RegionReadGuard guard(*this);
+
+        std::atomic<Chunk*>* slot = FindSlot(id.Coordinate.h, id.Coordinate.v, id.Coordinate.d);
+        return slot && slot->load(std::memory_order_acquire) == &SkyChunkMarker;
+    }
+
+    BlockType World::GetMissingChunkBlock(ChunkId id) const
+    {
+        return IsSkyChunk(id) ? EmptyBlock : InvalidBlock;
     }
 
     bool World::SurroundingChunksGenerated(ChunkId id) const
     {
-        std::lock_guard <std::mutex> lock(ChunkLock);
+        static constexpr int NeighborOffsets[10][3] =
+        {
+            { -1, -1, 0 }, { 0, -1, 0 }, { 1, -1, 0 },
+            { -1,  0, 0 },               { 1,  0, 0 },
+            { -1,  1, 0 }, { 0,  1, 0 }, { 1,  1, 0 },
+            { 0, 0, 1 }, { 0, 0, -1 },
+        };
 
-        for (int h = -1; h <= 1; h++)
+        RegionReadGuard guard(*this);
+
+        for (auto& offset : NeighborOffsets)
         {
-            for (int v = -1; v <= 1; v++)
-            {
-                if (h == 0 && v == 0)
-                    continue;
+            ChunkId sibling = id.Offset(offset[0], offset[1], offset[2]);
 
-                ChunkId siblingChunk;
-                siblingChunk.Coordinate.h = id.Coordinate.h + h;
-                siblingChunk.Coordinate.v = id.Coordinate.v + v;
+            // nothing will ever be generated below the world or in the sky
+            if (sibling.Coordinate.d < MinChunkLayer || IsSkyChunk(sibling))
+                continue;
 
-                auto itr = Chunks.find(siblingChunk.Id);
-                if (itr == Chunks.end() || itr->second.GetStatus() == ChunkStatus::Empty)
-                    return false;
-            }
+            std::atomic<Chunk*>* slot = FindSlot(sibling.Coordinate.h, sibling.Coordinate.v, sibling.Coordinate.d);
+            Chunk* chunk = slot ? slot->load(std::memory_order_acquire) : nullptr;
+            if (!chunk || chunk->GetStatus() < ChunkStatus::Generated)
+                return false;
         }
         return true;
     }
 
+    void World::MarkNeighborsDirty(ChunkId id)
+    {
+        static constexpr int NeighborOffsets[6][3] =
+        {
+            { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+        };
+
+        // only an atomic flag is touched, so a chunk that was just evicted and reused just gets an extra remesh
+        for (auto& offset : NeighborOffsets)
+        {
+            Chunk* chunk = GetChunk(id.Offset(offset[0], offset[1], offset[2]));
+            if (chunk)
+                chunk->MarkDirty();
+        }
+    }
+
+    std::atomic<Chunk*>* World::FindSlot(int32_t h, int32_t v, int32_t d) const
+    {
+        ChunkRegion* region = FindRegion(h >> ChunkRegion::RegionShift, v >> ChunkRegion::RegionShift, d >> ChunkRegion::RegionHeightShift);
+        if (!region)
+            return nullptr;
+
+        return &region->Chunks[ChunkRegion::GetIndex(h, v, d)];
+    }
+
+    std::atomic<Chunk*>& World::GetOrAddSlot(int32_t h, int32_t v, int32_t d)
+    {
+        int32_t regionH = h >> ChunkRegion::RegionShift;
+        int32_t regionV = v >> ChunkRegion::RegionShift;
+        int32_t regionD = d >> ChunkRegion::RegionHeightShift;
+
+        ChunkRegion* region = FindRegion(regionH, regionV, regionD);
+        if (!region)
+            region = &AddRegion(regionH, regionV, regionD);
+
+        return region->Chunks[ChunkRegion::GetIndex(h, v, d)];
+    }
+
+    ChunkRegion* World::FindRegion(int32_t regionH, int32_t regionV, int32_t regionD) const
+    {
+        RegionTable* table = Regions.load(std::memory_order_seq_cst);
+
+        size_t index = HashRegion(regionH, regionV, regionD, table->Capacity);
+        for (size_t probe = 0; probe < table->Capacity; probe++)
+        {
+            ChunkRegion* region = table->Slots[index].load(std::memory_order_seq_cst);
+            if (!region)
+                return nullptr;
+
+            if (region != &RemovedRegionMarker && region->H == regionH && region->V == regionV && region->D == regionD)
+                return region;
+
+            index = (index + 1) & (table->Capacity - 1);
+        }
+        return nullptr;
+    }
+
+    ChunkRegion& World::AddRegion(int32_t regionH, int32_t regionV, int32_t regionD)
+    {
+        RegionStorage.push_back(std::make_unique<ChunkRegion>());
+        ChunkRegion* region = RegionStorage.back().get();
+        region->H = regionH;
+        region->V = regionV;
+        region->D = regionD;
+
+        RegionTable* table = Regions.load(std::memory_order_relaxed);
+
+        // keep the table at most half full of regions and removed markers so probes stay short
+        RegionCount++;
+        if ((RegionCount + RemovedRegionCount) * 2 > table->Capacity)
+        {
+            size_t capacity = table->Capacity;
+            while (RegionCount * 2 > capacity)
+                capacity *= 2;
+
+            RebuildRegionTable(capacity);
+            return *region;
+        }
+
+        // a removed marker is reused, lookups passing over it just see a different region
+        size_t index = HashRegion(regionH, regionV, regionD, table->Capacity);
+        while (true)
+        {
+            ChunkRegion* existing = table->Slots[index].load(std::memory_order_relaxed);
+            if (existing == nullptr)
+                break;
+
+            if (existing == &RemovedRegionMarker)
+            {
+                RemovedRegionCount--;
+                break;
+            }
+
+            index = (index + 1) & (table->Capacity - 1);
+        }
+
+        table->Slots[index].store(region, std::memory_order_seq_cst);
+        return *region;
+    }
+
+    void World::RebuildRegionTable(size_t capacity)
+    {
+        auto newTable = std::make_unique<RegionTable>(capacity);
+        for (auto& region : RegionStorage)
+        {
+            size_t index = HashRegion(region->H, region->V, region->D, capacity);
+            while (newTable->Slots[index].load(std::memory_order_relaxed) != nullptr)
+                index = (index + 1) & (capacity - 1);
+
+            newTable->Slots[index].store(region.get(), std::memory_order_relaxed);
+        }
+
+        Regions.store(newTable.get(), std::memory_order_seq_cst);
+        RemovedRegionCount = 0;
+
+        // lookups that started before the swap may still be probing the old table
+        RetiredRegionTables.push_back(std::move(CurrentRegionTable));
+        CurrentRegionTable = std::move(newTable);
+    }
+
+    size_t World::HashRegion(int32_t regionH, int32_t regionV, int32_t regionD, size_t capacity)
+    {
+        uint64_t key = (uint64_t(uint32_t(regionH)) << 32) | uint32_t(regionV);
+        key ^= uint64_t(uint32_t(regionD)) * 0xC2B2AE3D27D4EB4Full;
+        key *= 0x9E3779B97F4A7C15ull;
+        return size_t(key >> 32) & (capacity - 1);
+    }
+
     BlockType World::GetVoxel(ChunkId chunk, int h, int v, int d)
     {
-        if (d < 0 || d >= Chunk::ChunkHeight)
-            return InvalidBlock;
+        WrapBlock(chunk, h, v, d);
+
+        Chunk* chunkData = GetChunk(chunk);
+        if (!chunkData)
+            return GetMissingChunkBlock(chunk);
+
+        return chunkData->GetVoxel(h, v, d);
+    }
+
+    bool World::BlockIsSolid(ChunkId chunk, int h, int v, int d)
+    {
+        WrapBlock(chunk, h, v, d);
+
+        Chunk* chunkData = GetChunk(chunk);
+        if (!chunkData)
+            return BlockRegistry::IsSolid(GetMissingChunkBlock(chunk));
+
+        return chunkData->BlockIsSolid(h, v, d);
+    }
+
+    void World::WrapBlock(ChunkId& chunk, int& h, int& v, int& d)
+    {
+        while (d < 0)
+        {
+            chunk.Coordinate.d -= 1;
+            d += Chunk::ChunkHeight;
+        }
+
+        while (d >= Chunk::ChunkHeight)
+        {
+            chunk.Coordinate.d += 1;
+            d -= Chunk::ChunkHeight;
+        }
 
         while (h < 0)
         {
@@ -185,20 +1458,36 @@ namespace Voxels
             chunk.Coordinate.v += 1;
             v -= Chunk::ChunkSize;
         }
-
-        Chunk* chunkData = GetChunk(chunk);
-        if (!chunkData)
-            return InvalidBlock;
-
-        return chunkData->GetVoxel(h, v, d);
     }
 
-    bool World::BlockIsSolid(ChunkId chunk, int h, int v, int d)
+    bool World::GetGroundDepth(int64_t worldH, int64_t worldV, int64_t& depth, bool opaque)
     {
-        BlockType block = GetVoxel(chunk, h, v, d);
-        if (block == InvalidBlock)
-            return true;
+        // floor division so negative positions land in the right chunk
+        int64_t chunkH = worldH >= 0 ? worldH / Chunk::ChunkSize : ((worldH + 1) / Chunk::ChunkSize) - 1;
+        int64_t chunkV = worldV >= 0 ? worldV / Chunk::ChunkSize : ((worldV + 1) / Chunk::ChunkSize) - 1;
+
+        int h = int(worldH - chunkH * Chunk::ChunkSize);
+        int v = int(worldV - chunkV * Chunk::ChunkSize);
+
+        // the layer range is fixed, so this is a handful of lookups at most
+        for (int32_t d = MaxChunkLayer; d >= MinChunkLayer; d--)
+        {
+            ChunkId id(int32_t(chunkH), int32_t(chunkV), d);
+            if (IsSkyChunk(id))
+                continue;
+
+            Chunk* chunk = GetChunk(id);
+            if (!chunk || chunk->GetStatus() < ChunkStatus::Generated)
+                return false;
+
+            int top = opaque ? chunk->GetTopOpaqueDepth(h, v) : chunk->GetTopSolidDepth(h, v);
+            if (top >= 0)
+            {
+                depth = int64_t(d) * Chunk::ChunkHeight + top;
+                return true;
+            }
+        }
 
-        return BlockInfos[block].Solid;
+        return false;
     }
-}
\ No newline at end of file
+}
@@ -14,7 +14,7 @@ namespace Voxels
         TerrainGenerationFunction = func;
     }
 
-    void WorldBuilder::SetPopulateFunction(std::function<void(Chunk&)> func)
+    void WorldBuilder::SetPopulateFunction(std::function<void(World&, Chunk&)> func)
     {
         PopulationGenerationFunction = func;
     }
@@ -26,12 +26,27 @@ namespace Voxels
 
     void WorldBuilder::Abort()
     {
+        // tasks that are already queued find nothing left to do
+        {
+            std::lock_guard guard(QueueMutex);
+            PendingChunks.clear();
+            ProcessingChunks.clear();
+            PendingPopulationChunks.clear();
+        }
+
         {
             std::lock_guard guard(RunMutex);
             RunQueue = false;
         }
         if (WorkerThread.joinable())
             WorkerThread.join();
+
+        Tasks::WaitForTasks();
+
+        // tasks that were running may have finished or queued chunks since
+        std::lock_guard guard(QueueMutex);
+        PendingPopulationChunks.clear();
+        CompletedChunks.clear();
     }
 
     void WorldBuilder::PushChunk(ChunkId chunk)
@@ -125,41 +140,66 @@ namespace Voxels
 
         if (PopPendingPopulationChunk(&processChunk))
         {
-            auto* chunk = WorldMap.GetChunk(processChunk.Coordinate.h, processChunk.Coordinate.v);
-
-            if (PopulationGenerationFunction)
-                PopulationGenerationFunction(*chunk);
-
-            chunk->SetStatus(ChunkStatus::Populated);
+            // the chunk may have been evicted while it waited, it will be generated again if it is still needed
+            ChunkHandle chunk = WorldMap.PinChunk(processChunk);
+            if (chunk && chunk->GetStatus() == ChunkStatus::Generated)
+            {
+                if (PopulationGenerationFunction)
+                    PopulationGenerationFunction(WorldMap, *chunk);
 
-            std::lock_guard outBoundGuard(QueueMutex);
-            CompletedChunks.push_back(processChunk);
+                if (chunk->TryTransition(ChunkStatus::Generated, ChunkStatus::Populated))
+                {
+                    std::lock_guard outBoundGuard(QueueMutex);
+                    CompletedChunks.push_back(processChunk);
+                }
+            }
 
             didSomething = true;
         }
 
         if (PopPendingChunk(&processChunk))
         {
-            auto& chunk = WorldMap.AddChunk(processChunk.Coordinate.h, processChunk.Coordinate.v);
-            if (chunk.GetStatus() != ChunkStatus::Empty)
+            // generate into a scratch chunk first so chunks of open sky never get storage
+            static thread_local Chunk scratch;
+            scratch.Id = processChunk;
+            scratch.Clear();
+
+            TerrainGenerationFunction(scratch);
+
+            if (scratch.IsEmpty())
+            {
+                WorldMap.SetSkyChunk(processChunk);
+                return true;
+            }
+
+            // chunks are only evicted once they are generated, so the new chunk can always be pinned
+            WorldMap.AddChunk(processChunk);
+            ChunkHandle chunk = WorldMap.PinChunk(processChunk);
+
+            // another task may already own this chunk
+            if (!chunk || !chunk->TryTransition(ChunkStatus::Empty, ChunkStatus::Generating))
                 return true;
 
-            chunk.SetStatus(ChunkStatus::Generating);
-            TerrainGenerationFunction(chunk);
-            chunk.SetStatus(ChunkStatus::Generated);
+            chunk->TakeBlocks(scratch);
+            chunk->TryTransition(ChunkStatus::Generating, ChunkStatus::Generated);
+
+            // neighbors that were meshed while this chunk was missing have the wrong border faces
+            WorldMap.MarkNeighborsDirty(processChunk);
 
             if (WorldMap.SurroundingChunksGenerated(processChunk))
             {
                 if (PopulationGenerationFunction)
-                    PopulationGenerationFunction(chunk);
+                    PopulationGenerationFunction(WorldMap, *chunk);
 
-                chunk.SetStatus(ChunkStatus::Populated);
-
-                std::lock_guard outBoundGuard(QueueMutex);
-                CompletedChunks.push_back(processChunk);
+                if (chunk->TryTransition(ChunkStatus::Generated, ChunkStatus::Populated))
+                {
+                    std::lock_guard outBoundGuard(QueueMutex);
+                    CompletedChunks.push_back(processChunk);
+                }
             }
             else
             {
+                std::lock_guard pendingGuard(QueueMutex);
                 PendingPopulationChunks.push_back(processChunk);
             }
             didSomething = true;
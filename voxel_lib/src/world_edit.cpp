@@ -0,0 +1,304 @@
+#include "voxel_lib.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Voxels
+{
+    namespace
+    {
+        // floor division so negative positions land in the right chunk
+        int64_t FloorDiv(int64_t value, int64_t size)
+        {
+            return value >= 0 ? value / size : ((value + 1) / size) - 1;
+        }
+    }
+
+    ChunkId World::GetChunkIdForBlock(const BlockPosition& position)
+    {
+        return ChunkId(int32_t(FloorDiv(position.H, Chunk::ChunkSize)), int32_t(FloorDiv(position.V, Chunk::ChunkSize)), int32_t(FloorDiv(position.D, Chunk::ChunkHeight)));
+    }
+
+    BlockPosition World::GetChunkOrigin(ChunkId id)
+    {
+        return BlockPosition{ int64_t(id.Coordinate.h) * Chunk::ChunkSize, int64_t(id.Coordinate.v) * Chunk::ChunkSize, int64_t(id.Coordinate.d) * Chunk::ChunkHeight };
+    }
+
+    void World::SetVoxel(const BlockPosition& position, BlockType block, DirtyChunkSet* dirtyChunks)
+    {
+        FillBox(position, position, block, dirtyChunks);
+    }
+
+    void World::FillBox(const BlockPosition& min, const BlockPosition& max, BlockType block, DirtyChunkSet* dirtyChunks)
+    {
+        EditChunks(min, max, block != EmptyBlock, dirtyChunks, [block](Chunk& chunk, const BlockPosition&, const ChunkEditBox& box)
+            {
+                int count = box.MaxH - box.MinH + 1;
+                for (int d = box.MinD; d <= box.MaxD; d++)
+                {
+                    for (int v = box.MinV; v <= box.MaxV; v++)
+                        chunk.FillRow(box.MinH, v, d, count, block);
+                }
+            });
+    }
+
+    void World::FillSphere(const BlockPosition& center, int radius, BlockType block, DirtyChunkSet* dirtyChunks)
+    {
+        if (radius < 0)
+            return;
+
+        BlockPosition min{ center.H - radius, center.V - radius, center.D - radius };
+        BlockPosition max{ center.H + radius, center.V + radius, center.D + radius };
+
+        int64_t radiusSquared = int64_t(radius) * radius;
+
+        EditChunks(min, max, block != EmptyBlock, dirtyChunks, [&](Chunk& chunk, const BlockPosition& origin, const ChunkEditBox& box)
+            {
+                for (int d = box.MinD; d <= box.MaxD; d++)
+                {
+                    int64_t offsetD = origin.D + d - center.D;
+                    for (int v = box.MinV; v <= box.MaxV; v++)
+                    {
+                        int64_t offsetV = origin.V + v - center.V;
+                        int64_t remaining = radiusSquared - offsetD * offsetD - offsetV * offsetV;
+                        if (remaining < 0)
+                            continue;
+
+                        // each row of a sphere is one solid run
+                        int64_t halfWidth = int64_t(std::sqrt(double(remaining)));
+
+                        int start = int(std::max<int64_t>(box.MinH, center.H - halfWidth - origin.H));
+                        int end = int(std::min<int64_t>(box.MaxH, center.H + halfWidth - origin.H));
+                        if (start <= end)
+                            chunk.FillRow(start, v, d, end - start + 1, block);
+                    }
+                }
+            });
+    }
+
+    void World::DrawLine(const BlockPosition& start, const BlockPosition& end, BlockType block, DirtyChunkSet* dirtyChunks)
+    {
+        // the chunk is only looked up again when the line crosses into a new one
+        ChunkId currentId;
+        ChunkHandle chunk;
+        ChunkEditBox box;
+        bool boxUsed = false;
+
+        auto flush = [&]()
+            {
+                if (chunk && boxUsed)
+                    MarkDirty(currentId, box, dirtyChunks);
+                boxUsed = false;
+            };
+
+        auto plot = [&](const BlockPosition& position)
+            {
+                ChunkId id = GetChunkIdForBlock(position);
+                if (id.Coordinate.d < MinChunkLayer || id.Coordinate.d > MaxChunkLayer)
+                    return;
+
+                if (id.Id != currentId.Id)
+                {
+                    flush();
+                    currentId = id;
+                    chunk = PinChunkForEdit(id, block != EmptyBlock);
+                }
+
+                if (!chunk)
+                    return;
+
+                BlockPosition origin = GetChunkOrigin(id);
+                int h = int(position.H - origin.H);
+                int v = int(position.V - origin.V);
+                int d = int(position.D - origin.D);
+
+                chunk->SetVoxel(h, v, d, block);
+                chunk->MarkModified();
+
+                if (!boxUsed)
+                {
+                    box = ChunkEditBox{ h, v, d, h, v, d };
+                    boxUsed = true;
+                }
+                else
+                {
+                    box.MinH = std::min(box.MinH, h);
+                    box.MinV = std::min(box.MinV, v);
+                    box.MinD = std::min(box.MinD, d);
+                    box.MaxH = std::max(box.MaxH, h);
+                    box.MaxV = std::max(box.MaxV, v);
+                    box.MaxD = std::max(box.MaxD, d);
+                }
+            };
+
+        // 3d bresenham, every axis steps when its error runs out
+        int64_t deltaH = std::abs(end.H - start.H);
+        int64_t deltaV = std::abs(end.V - start.V);
+        int64_t deltaD = std::abs(end.D - start.D);
+
+        int64_t stepH = end.H >= start.H ? 1 : -1;
+        int64_t stepV = end.V >= start.V ? 1 : -1;
+        int64_t stepD = end.D >= start.D ? 1 : -1;
+
+        int64_t steps = std::max(deltaH, std::max(deltaV, deltaD));
+
+        int64_t errorH = steps / 2;
+        int64_t errorV = steps / 2;
+        int64_t errorD = steps / 2;
+
+        BlockPosition position = start;
+        for (int64_t i = 0; i <= steps; i++)
+        {
+            plot(position);
+
+            errorH -= deltaH;
+            if (errorH < 0)
+            {
+                position.H += stepH;
+                errorH += steps;
+            }
+
+            errorV -= deltaV;
+            if (errorV < 0)
+            {
+                position.V += stepV;
+                errorV += steps;
+            }
+
+            errorD -= deltaD;
+            if (errorD < 0)
+            {
+                position.D += stepD;
+                errorD += steps;
+            }
+        }
+
+        flush();
+    }
+
+    void World::PasteSchematic(const Schematic& schematic, const BlockPosition& origin, DirtyChunkSet* dirtyChunks)
+    {
+        if (schematic.SizeH <= 0 || schematic.SizeV <= 0 || schematic.SizeD <= 0)
+            return;
+
+        if (schematic.Blocks.size() != size_t(schematic.SizeH) * schematic.SizeV * schematic.SizeD)
+        {
+            TraceLog(LOG_WARNING, "Schematic has %d blocks, expected %d", int(schematic.Blocks.size()), schematic.SizeH * schematic.SizeV * schematic.SizeD);
+            return;
+        }
+
+        BlockPosition max{ origin.H + schematic.SizeH - 1, origin.V + schematic.SizeV - 1, origin.D + schematic.SizeD - 1 };
+
+        EditChunks(origin, max, true, dirtyChunks, [&](Chunk& chunk, const BlockPosition& chunkOrigin, const ChunkEditBox& box)
+            {
+                int count = box.MaxH - box.MinH + 1;
+                int schematicH = int(chunkOrigin.H + box.MinH - origin.H);
+
+                BlockType row[Chunk::ChunkSize];
+
+                for (int d = box.MinD; d <= box.MaxD; d++)
+                {
+                    int schematicD = int(chunkOrigin.D + d - origin.D);
+                    for (int v = box.MinV; v <= box.MaxV; v++)
+                    {
+                        int schematicV = int(chunkOrigin.V + v - origin.V);
+
+                        // decode one run of palette indexes and write it in one go
+                        const uint8_t* indexes = schematic.Blocks.data() + schematic.GetIndex(schematicH, schematicV, schematicD);
+                        for (int i = 0; i < count; i++)
+                            row[i] = indexes[i] < schematic.Palette.size() ? schematic.Palette[indexes[i]] : InvalidBlock;
+
+                        chunk.SetRow(box.MinH, v, d, count, row);
+                    }
+                }
+            });
+    }
+
+    void World::EditChunks(const BlockPosition& min, const BlockPosition& max, bool addSkyChunks, DirtyChunkSet* dirtyChunks, const ChunkEditFunction& func)
+    {
+        BlockPosition low{ std::min(min.H, max.H), std::min(min.V, max.V), std::min(min.D, max.D) };
+        BlockPosition high{ std::max(min.H, max.H), std::max(min.V, max.V), std::max(min.D, max.D) };
+
+        ChunkId lowChunk = GetChunkIdForBlock(low);
+        ChunkId highChunk = GetChunkIdForBlock(high);
+
+        // nothing outside the world layers can be edited
+        int32_t minD = std::max(int32_t(lowChunk.Coordinate.d), MinChunkLayer);
+        int32_t maxD = std::min(int32_t(highChunk.Coordinate.d), MaxChunkLayer);
+
+        for (int32_t chunkD = minD; chunkD <= maxD; chunkD++)
+        {
+            for (int32_t chunkV = int32_t(lowChunk.Coordinate.v); chunkV <= int32_t(highChunk.Coordinate.v); chunkV++)
+            {
+                for (int32_t chunkH = int32_t(lowChunk.Coordinate.h); chunkH <= int32_t(highChunk.Coordinate.h); chunkH++)
+                {
+                    ChunkId id(chunkH, chunkV, chunkD);
+
+                    ChunkHandle chunk = PinChunkForEdit(id, addSkyChunks);
+                    if (!chunk)
+                        continue;
+
+                    BlockPosition origin = GetChunkOrigin(id);
+
+                    ChunkEditBox box;
+                    box.MinH = int(std::max<int64_t>(low.H - origin.H, 0));
+                    box.MinV = int(std::max<int64_t>(low.V - origin.V, 0));
+                    box.MinD = int(std::max<int64_t>(low.D - origin.D, 0));
+                    box.MaxH = int(std::min<int64_t>(high.H - origin.H, Chunk::ChunkSize - 1));
+                    box.MaxV = int(std::min<int64_t>(high.V - origin.V, Chunk::ChunkSize - 1));
+                    box.MaxD = int(std::min<int64_t>(high.D - origin.D, Chunk::ChunkHeight - 1));
+
+                    func(*chunk, origin, box);
+                    chunk->MarkModified();
+                    MarkDirty(id, box, dirtyChunks);
+                }
+            }
+        }
+    }
+
+    ChunkHandle World::PinChunkForEdit(ChunkId id, bool addSkyChunk)
+    {
+        if (addSkyChunk && IsSkyChunk(id) && id.Coordinate.d <= MaxChunkLayer)
+        {
+            // building into open sky, the new chunk has nothing left to generate
+            Chunk& chunk = AddChunk(id);
+            chunk.TryTransition(ChunkStatus::Empty, ChunkStatus::Populated);
+        }
+
+        // chunks that are still generating would overwrite the edit
+        ChunkHandle chunk = PinChunk(id);
+        if (!chunk || chunk->GetStatus() < ChunkStatus::Generated)
+            return ChunkHandle();
+
+        return chunk;
+    }
+
+    void World::MarkDirty(ChunkId id, const ChunkEditBox& box, DirtyChunkSet* dirtyChunks)
+    {
+        auto mark = [this, dirtyChunks](ChunkId dirtyId)
+            {
+                if (dirtyChunks)
+                    dirtyChunks->insert(dirtyId.Id);
+
+                Chunk* chunk = GetChunk(dirtyId);
+                if (chunk)
+                    chunk->MarkDirty();
+            };
+
+        mark(id);
+
+        // neighbors mesh the faces against our border, so they change too
+        if (box.MinH == 0)
+            mark(id.Offset(-1, 0, 0));
+        if (box.MaxH == Chunk::ChunkSize - 1)
+            mark(id.Offset(1, 0, 0));
+        if (box.MinV == 0)
+            mark(id.Offset(0, -1, 0));
+        if (box.MaxV == Chunk::ChunkSize - 1)
+            mark(id.Offset(0, 1, 0));
+        if (box.MinD == 0 && id.Coordinate.d > MinChunkLayer)
+            mark(id.Offset(0, 0, -1));
+        if (box.MaxD == Chunk::ChunkHeight - 1 && id.Coordinate.d < MaxChunkLayer)
+            mark(id.Offset(0, 0, 1));
+    }
+}